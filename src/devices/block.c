@@ -3,7 +3,33 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Pages in the bounce buffer through which merged batches are
+   transferred, and the number of sectors that fit in it, which
+   is the largest batch the elevator will build by merging. */
+#define MERGE_PAGES 4
+#define MERGE_MAX (MERGE_PAGES * PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Timer ticks a request may wait before it is served ahead of
+   requests that are closer to the disk head. */
+#define DEADLINE_TICKS (TIMER_FREQ / 2)
+
+/* A batch: requests that the elevator merged into one driver
+   request. */
+struct batch
+  {
+    struct block *block;                /* Device it belongs to. */
+    bool busy;                          /* In progress with the driver? */
+    struct list requests;               /* Requests in the batch. */
+    struct block_request xfer;          /* Driver request for the batch. */
+    void *bounce;                       /* Buffer for merging, or null. */
+  };
 
 /* A block device. */
 struct block
@@ -19,6 +45,22 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    /* Request queue, for asynchronous devices. */
+    struct list queue;                  /* Pending requests, oldest first. */
+    int depth;                          /* Batches driver takes at once. */
+    int busy_cnt;                       /* Batches in progress. */
+    struct batch batches[BLOCK_DEPTH_MAX];
+    bool bounces_allocated;             /* Tried to allocate bounces? */
+    block_sector_t head;                /* Sector just past last batch. */
+
+    unsigned long long batch_cnt;       /* Number of batches dispatched. */
+    unsigned long long merge_cnt;       /* Requests merged into a batch. */
+    unsigned long long depth_sum;       /* Sum of queue depth at dispatch. */
+    size_t depth_max;                   /* Deepest the queue has been. */
+    unsigned long long seek_sum;        /* Sum of sectors sought at dispatch. */
+    struct blkstat_dir reads;           /* Completed reads. */
+    struct blkstat_dir writes;          /* Completed writes. */
   };
 
 /* List of all block devices. */
@@ -28,6 +70,7 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void batch_done (struct block_request *);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -113,6 +156,18 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Verifies that CNT, which must be between 1 and
+   BLOCK_MULTIPLE_MAX, sectors starting at SECTOR all lie within
+   BLOCK.  Panics if not. */
+static void
+check_sectors (struct block *block, block_sector_t sector, size_t cnt)
+{
+  ASSERT (cnt > 0 && cnt <= BLOCK_MULTIPLE_MAX);
+  check_sector (block, sector);
+  if (cnt > block->size - sector)
+    check_sector (block, block->size);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -120,9 +175,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  block_read_multiple (block, sector, 1, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,12 +186,437 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  block_write_multiple (block, sector, 1, buffer);
+}
+
+static void wait_transfer (struct block *, block_sector_t, size_t cnt,
+                           void *buffer, bool write);
+
+/* Reads CNT consecutive sectors, starting at SECTOR, from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  CNT must be between 1 and BLOCK_MULTIPLE_MAX.  A driver
+   that supports it does this as a single request; otherwise the
+   sectors are read one at a time.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffer)
+{
+  wait_transfer (block, sector, cnt, buffer, false);
+}
+
+/* Writes CNT consecutive sectors, starting at SECTOR, to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   CNT must be between 1 and BLOCK_MULTIPLE_MAX.  Returns after
+   the block device has acknowledged receiving all of the data.
+   A driver that supports it does this as a single request;
+   otherwise the sectors are written one at a time.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                      const void *buffer)
+{
+  wait_transfer (block, sector, cnt, (void *) buffer, true);
 }
 
+/* Completion function for wait_transfer()'s requests. */
+static void
+wake_submitter (struct block_request *r)
+{
+  sema_up (r->aux);
+}
+
+/* Submits a transfer of CNT sectors starting at SECTOR between
+   BLOCK and BUFFER, in the direction given by WRITE, and waits
+   for it to complete.
+
+   A request to an asynchronous device may be carried out in an
+   interrupt handler while another process's page table is
+   active, so a user BUFFER for one must be staged through kernel
+   memory.  The file system already hands us kernel buffers, so
+   this is only a fallback: it stages a page at a time if a page
+   is free, otherwise a sector at a time through the stack. */
+static void
+wait_transfer (struct block *block, block_sector_t sector, size_t cnt,
+               void *buffer, bool write)
+{
+  struct block_request r;
+  struct semaphore done;
+  uint8_t sector_bounce[BLOCK_SECTOR_SIZE];
+  uint8_t *page = NULL;
+  uint8_t *bounce = NULL;
+  size_t bounce_cnt = 0;
+  uint8_t *p = buffer;
+
+  check_sectors (block, sector, cnt);
+  if (is_user_vaddr (buffer) && block->ops->start != NULL)
+    {
+      page = palloc_get_page (0);
+      bounce = page != NULL ? page : sector_bounce;
+      bounce_cnt = page != NULL ? PGSIZE / BLOCK_SECTOR_SIZE : 1;
+    }
+
+  sema_init (&done, 0);
+  r.complete = wake_submitter;
+  r.aux = &done;
+  r.write = write;
+  while (cnt > 0)
+    {
+      r.sector = sector;
+      r.cnt = cnt;
+      r.buffer = p;
+      if (bounce != NULL)
+        {
+          if (r.cnt > bounce_cnt)
+            r.cnt = bounce_cnt;
+          r.buffer = bounce;
+          if (write)
+            memcpy (bounce, p, r.cnt * BLOCK_SECTOR_SIZE);
+        }
+
+      block_submit (block, &r);
+      sema_down (&done);
+
+      if (bounce != NULL && !write)
+        memcpy (p, bounce, r.cnt * BLOCK_SECTOR_SIZE);
+      sector += r.cnt;
+      cnt -= r.cnt;
+      p += r.cnt * BLOCK_SECTOR_SIZE;
+    }
+
+  palloc_free_page (page);
+}
+
+/* Request queue.
+
+   Each asynchronous block device queues the requests submitted
+   to it and keeps batches of them in progress with its driver,
+   as many at once as the driver's DEPTH allows.  A new batch is
+   dispatched when a request arrives while the driver has room or,
+   usually in the driver's interrupt handler, when an earlier
+   batch completes.  The queue is protected by turning interrupts
+   off.
+
+   The elevator is C-LOOK: it sweeps upward from the sector where
+   the last batch ended, then jumps back to the lowest pending
+   request.  To keep a steady stream of nearby requests from
+   starving a distant one, a request that has waited for
+   DEADLINE_TICKS is served first regardless of position.
+
+   Requests in the same direction that continue exactly where the
+   batch so far ends are merged into it, up to MERGE_MAX sectors
+   in all, and the whole batch is handed to the driver as one request
+   through the batch's bounce buffer.
+
+   Synchronous devices have no queue: each request is carried out
+   by the submitting thread as soon as it is submitted. */
+
+static void dispatch (struct block *);
+static struct block_request *pick_request (struct block *);
+static struct block_request *find_successor (struct block *, bool write,
+                                             block_sector_t sector,
+                                             size_t max_cnt);
+static void transfer (struct block *, bool write, block_sector_t, size_t cnt,
+                      void *buffer);
+static uint64_t read_tsc (void);
+static void account (struct block *, const struct block_request *,
+                     uint64_t now);
+
+/* Submits request R to BLOCK and returns, usually before R has
+   been carried out.  R's COMPLETE function is called when it
+   has.  May be called from an interrupt handler, but only if
+   BLOCK is asynchronous, as partitions of IDE disks are. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  enum intr_level old_level;
+  size_t depth;
+
+  check_sectors (block, r->sector, r->cnt);
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+  ASSERT (r->complete != NULL);
+
+  if (block->ops->start == NULL)
+    {
+      ASSERT (!intr_context ());
+      r->submitted = r->started = read_tsc ();
+      transfer (block, r->write, r->sector, r->cnt, r->buffer);
+      old_level = intr_disable ();
+      if (r->write)
+        block->write_cnt += r->cnt;
+      else
+        block->read_cnt += r->cnt;
+      account (block, r, read_tsc ());
+      intr_set_level (old_level);
+      r->complete (r);
+      return;
+    }
+
+  ASSERT (is_kernel_vaddr (r->buffer));
+
+  /* Requests start queuing up, so merging becomes possible.
+     Allocate bounce buffers for that, which we cannot do later
+     in an interrupt handler.  The flag is claimed with
+     interrupts off so that only one thread allocates them. */
+  if (!block->bounces_allocated && !intr_context ())
+    {
+      bool claimed;
+      int i;
+
+      old_level = intr_disable ();
+      claimed = !block->bounces_allocated && block->busy_cnt > 0;
+      if (claimed)
+        block->bounces_allocated = true;
+      intr_set_level (old_level);
+
+      if (claimed)
+        for (i = 0; i < block->depth; i++)
+          block->batches[i].bounce = palloc_get_multiple (0, MERGE_PAGES);
+    }
+
+  r->deadline = timer_ticks () + DEADLINE_TICKS;
+  r->submitted = read_tsc ();
+
+  old_level = intr_disable ();
+  if (r->write)
+    block->write_cnt += r->cnt;
+  else
+    block->read_cnt += r->cnt;
+  list_push_back (&block->queue, &r->elem);
+  depth = list_size (&block->queue);
+  if (depth > block->depth_max)
+    block->depth_max = depth;
+  while (block->busy_cnt < block->depth && !list_empty (&block->queue))
+    dispatch (block);
+  intr_set_level (old_level);
+}
+
+/* Takes the next batch of requests off BLOCK's queue and starts
+   it in BLOCK's driver.  Must be called with interrupts off and
+   fewer than BLOCK's depth batches in progress. */
+static void
+dispatch (struct block *block)
+{
+  struct batch *b;
+  struct block_request *first, *r;
+  struct block_request *xfer;
+  struct list_elem *e;
+  uint64_t now = read_tsc ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (block->busy_cnt < block->depth);
+  ASSERT (!list_empty (&block->queue));
+
+  for (b = block->batches; b->busy; b++)
+    continue;
+  xfer = &b->xfer;
+  b->busy = true;
+  block->busy_cnt++;
+  block->batch_cnt++;
+  block->depth_sum += list_size (&block->queue);
+
+  /* Choose a request and merge its successors into it.  A request
+     of MERGE_MAX sectors or more already fills a batch, so it goes
+     to the driver by itself. */
+  first = pick_request (block);
+  list_remove (&first->elem);
+  list_push_back (&b->requests, &first->elem);
+  first->started = now;
+  xfer->sector = first->sector;
+  xfer->cnt = first->cnt;
+  xfer->write = first->write;
+  while (b->bounce != NULL
+         && xfer->cnt < MERGE_MAX
+         && (r = find_successor (block, xfer->write,
+                                 xfer->sector + xfer->cnt,
+                                 MERGE_MAX - xfer->cnt)) != NULL)
+    {
+      list_remove (&r->elem);
+      list_push_back (&b->requests, &r->elem);
+      r->started = now;
+      xfer->cnt += r->cnt;
+      block->merge_cnt++;
+    }
+  block->seek_sum += (first->sector > block->head
+                      ? first->sector - block->head
+                      : block->head - first->sector);
+  block->head = xfer->sector + xfer->cnt;
+
+  /* Stage a merged write in the bounce buffer. */
+  if (xfer->cnt == first->cnt)
+    xfer->buffer = first->buffer;
+  else
+    {
+      xfer->buffer = b->bounce;
+      if (xfer->write)
+        {
+          uint8_t *p = b->bounce;
+          for (e = list_begin (&b->requests); e != list_end (&b->requests);
+               e = list_next (e))
+            {
+              r = list_entry (e, struct block_request, elem);
+              memcpy (p, r->buffer, r->cnt * BLOCK_SECTOR_SIZE);
+              p += r->cnt * BLOCK_SECTOR_SIZE;
+            }
+        }
+    }
+
+  /* The driver may complete XFER before returning, so we must
+     not touch it or the batch after this. */
+  block->ops->start (block->aux, xfer);
+}
+
+/* Completion function for batches, whose driver request is
+   XFER.  Completes the batch's requests and dispatches more
+   batches, if any are waiting. */
+static void
+batch_done (struct block_request *xfer)
+{
+  struct batch *b = xfer->aux;
+  struct block *block = b->block;
+  uint8_t *p = xfer->buffer;
+  uint64_t now = read_tsc ();
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  ASSERT (b->busy);
+  while (!list_empty (&b->requests))
+    {
+      struct block_request *r
+        = list_entry (list_pop_front (&b->requests),
+                      struct block_request, elem);
+      if (!r->write && xfer->buffer == b->bounce)
+        memcpy (r->buffer, p, r->cnt * BLOCK_SECTOR_SIZE);
+      p += r->cnt * BLOCK_SECTOR_SIZE;
+      account (block, r, now);
+      r->complete (r);
+    }
+  b->busy = false;
+  block->busy_cnt--;
+  while (block->busy_cnt < block->depth && !list_empty (&block->queue))
+    dispatch (block);
+  intr_set_level (old_level);
+}
+
+/* Returns the request in BLOCK's queue that should be served
+   next: the oldest request if it is past its deadline, otherwise
+   the lowest one at or beyond the head, otherwise the lowest one
+   overall. */
+static struct block_request *
+pick_request (struct block *block)
+{
+  struct block_request *oldest, *next = NULL, *lowest = NULL;
+  struct list_elem *e;
+
+  oldest = list_entry (list_front (&block->queue), struct block_request, elem);
+  if (timer_ticks () >= oldest->deadline)
+    return oldest;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      if (lowest == NULL || r->sector < lowest->sector)
+        lowest = r;
+      if (r->sector >= block->head
+          && (next == NULL || r->sector < next->sector))
+        next = r;
+    }
+  return next != NULL ? next : lowest;
+}
+
+/* Returns a request in BLOCK's queue in the direction given by
+   WRITE that starts at SECTOR and covers no more than MAX_CNT
+   sectors, or a null pointer if there is none. */
+static struct block_request *
+find_successor (struct block *block, bool write, block_sector_t sector,
+                size_t max_cnt)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      if (r->write == write && r->sector == sector && r->cnt <= max_cnt)
+        return r;
+    }
+  return NULL;
+}
+
+/* Transfers CNT sectors starting at SECTOR between synchronous
+   BLOCK and BUFFER, in the direction given by WRITE, as one
+   driver request if the driver supports it or one sector at a
+   time otherwise. */
+static void
+transfer (struct block *block, bool write, block_sector_t sector, size_t cnt,
+          void *buffer)
+{
+  uint8_t *p = buffer;
+  size_t i;
+
+  if (write)
+    {
+      if (block->ops->write_multiple != NULL)
+        block->ops->write_multiple (block->aux, sector, cnt, buffer);
+      else
+        for (i = 0; i < cnt; i++, p += BLOCK_SECTOR_SIZE)
+          block->ops->write (block->aux, sector + i, p);
+    }
+  else
+    {
+      if (block->ops->read_multiple != NULL)
+        block->ops->read_multiple (block->aux, sector, cnt, buffer);
+      else
+        for (i = 0; i < cnt; i++, p += BLOCK_SECTOR_SIZE)
+          block->ops->read (block->aux, sector + i, p);
+    }
+}
+
+/* Returns the CPU's time stamp counter, which counts cycles. */
+static uint64_t
+read_tsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Adds CYCLES to the latency histogram HIST. */
+static void
+add_to_histogram (unsigned hist[BLKSTAT_BUCKETS], uint64_t cycles)
+{
+  int bucket = 0;
+
+  while (cycles > 1 && bucket < BLKSTAT_BUCKETS - 1)
+    {
+      cycles >>= 1;
+      bucket++;
+    }
+  hist[bucket]++;
+}
+
+/* Counts request R, which BLOCK completed at TSC value NOW, in
+   BLOCK's statistics.  Must be called with interrupts off. */
+static void
+account (struct block *block, const struct block_request *r, uint64_t now)
+{
+  struct blkstat_dir *d = r->write ? &block->writes : &block->reads;
+  uint64_t wait = r->started - r->submitted;
+  uint64_t service = now - r->started;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  d->reqs++;
+  d->bytes += r->cnt * BLOCK_SECTOR_SIZE;
+  d->wait += wait;
+  d->service += service;
+  add_to_histogram (d->wait_hist, wait);
+  add_to_histogram (d->service_hist, service);
+}
+
 /* Returns the number of sectors in BLOCK. */
 block_sector_t
 block_size (struct block *block)
@@ -160,6 +638,38 @@ block_type (struct block *block)
   return block->type;
 }
 
+/* Fills in ST with BLOCK's name, type, and size, and the
+   statistics for the requests it has completed so far. */
+void
+block_get_stats (struct block *block, struct blkstat *st)
+{
+  enum intr_level old_level;
+
+  strlcpy (st->name, block->name, sizeof st->name);
+  strlcpy (st->type, block_type_name (block->type), sizeof st->type);
+  st->role = (block->type < BLOCK_ROLE_CNT
+              && block_by_role[block->type] == block);
+  st->size = block->size;
+
+  old_level = intr_disable ();
+  st->read = block->reads;
+  st->write = block->writes;
+  intr_set_level (old_level);
+}
+
+/* Prints the statistics D for KIND ("read" or "write") requests
+   completed by the block device named NAME, if there were any. */
+static void
+print_dir_stats (const char *name, const char *kind,
+                 const struct blkstat_dir *d)
+{
+  if (d->reqs > 0)
+    printf ("%s: %llu %ss, %llu bytes, "
+            "avg wait %llu cycles, avg service %llu cycles\n",
+            name, d->reqs, kind, d->bytes,
+            d->wait / d->reqs, d->service / d->reqs);
+}
+
 /* Prints statistics for each block device used for a Pintos role. */
 void
 block_print_stats (void)
@@ -174,6 +684,14 @@ block_print_stats (void)
           printf ("%s (%s): %llu reads, %llu writes\n",
                   block->name, block_type_name (block->type),
                   block->read_cnt, block->write_cnt);
+          if (block->batch_cnt > 0)
+            printf ("%s: %llu batches, %llu merged requests, "
+                    "queue depth avg %llu max %zu, seek avg %llu sectors\n",
+                    block->name, block->batch_cnt, block->merge_cnt,
+                    block->depth_sum / block->batch_cnt, block->depth_max,
+                    block->seek_sum / block->batch_cnt);
+          print_dir_stats (block->name, "read", &block->reads);
+          print_dir_stats (block->name, "write", &block->writes);
         }
     }
 }
@@ -189,6 +707,8 @@ block_register (const char *name, enum block_type type,
                 const struct block_operations *ops, void *aux)
 {
   struct block *block = malloc (sizeof *block);
+  int i;
+
   if (block == NULL)
     PANIC ("Failed to allocate memory for block device descriptor");
 
@@ -200,6 +720,29 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  list_init (&block->queue);
+  block->depth = ops->depth > 0 ? ops->depth : 1;
+  ASSERT (block->depth <= BLOCK_DEPTH_MAX);
+  block->busy_cnt = 0;
+  for (i = 0; i < BLOCK_DEPTH_MAX; i++)
+    {
+      struct batch *b = &block->batches[i];
+      b->block = block;
+      b->busy = false;
+      list_init (&b->requests);
+      b->xfer.complete = batch_done;
+      b->xfer.aux = b;
+      b->bounce = NULL;
+    }
+  block->bounces_allocated = false;
+  block->head = 0;
+  block->batch_cnt = 0;
+  block->merge_cnt = 0;
+  block->depth_sum = 0;
+  block->depth_max = 0;
+  block->seek_sum = 0;
+  memset (&block->reads, 0, sizeof block->reads);
+  memset (&block->writes, 0, sizeof block->writes);
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
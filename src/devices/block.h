@@ -1,8 +1,11 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <blkstat.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -14,6 +17,14 @@
    Good enough for devices up to 2 TB. */
 typedef uint32_t block_sector_t;
 
+/* Maximum number of sectors in one block_read_multiple() or
+   block_write_multiple() call, or in one block_request. */
+#define BLOCK_MULTIPLE_MAX 256
+
+/* Maximum number of requests that the block layer keeps in
+   progress with an asynchronous driver at once. */
+#define BLOCK_DEPTH_MAX 4
+
 /* Format specifier for printf(), e.g.:
    printf ("sector=%"PRDSNu"\n", sector); */
 #define PRDSNu PRIu32
@@ -53,18 +64,69 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* An asynchronous transfer between a block device and memory.
+   The submitter fills in the first group of members and must
+   leave the request alone until COMPLETE is called. */
+struct block_request
+  {
+    block_sector_t sector;      /* First sector. */
+    size_t cnt;                 /* Sectors, 1 to BLOCK_MULTIPLE_MAX. */
+    void *buffer;               /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    bool write;                 /* Write (true) or read (false)? */
+
+    /* Called once the transfer is done, usually from an
+       interrupt handler, so it must not sleep. */
+    void (*complete) (struct block_request *);
+    void *aux;                  /* For use by COMPLETE. */
+
+    /* Owned by the block layer. */
+    struct list_elem elem;      /* Element in a request queue. */
+    int64_t deadline;           /* Timer tick to be served by. */
+    uint64_t submitted;         /* TSC when submitted. */
+    uint64_t started;           /* TSC when handed to the driver. */
+  };
+
+void block_submit (struct block *, struct block_request *);
+
 /* Statistics. */
+void block_get_stats (struct block *, struct blkstat *);
 void block_print_stats (void);
 
-/* Lower-level interface to block device drivers. */
+/* Lower-level interface to block device drivers.
+
+   A driver provides either START, which makes the device
+   asynchronous, or READ and WRITE, which make it synchronous. */
 
 struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional.  Transfer CNT consecutive sectors, 1 to
+       BLOCK_MULTIPLE_MAX of them, as one request.  If null, the
+       block layer calls READ or WRITE once per sector instead. */
+    void (*read_multiple) (void *aux, block_sector_t, size_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *buffer);
+
+    /* Starts carrying out REQUEST and returns without waiting
+       for it; the driver calls REQUEST's COMPLETE function when
+       it is done.  Called with interrupts off, possibly from an
+       interrupt handler.  The block layer has at most DEPTH
+       requests outstanding per device at a time. */
+    void (*start) (void *aux, struct block_request *);
+
+    /* Number of requests, 1 to BLOCK_DEPTH_MAX, that START
+       accepts before earlier ones complete.  0 means 1. */
+    int depth;
   };
 
 struct block *block_register (const char *name, enum block_type,
@@ -1,17 +1,31 @@
 #include "devices/ide.h"
 #include <ctype.h>
 #include <debug.h>
+#include <list.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   If the controller is a PCI bus master IDE controller, as
+   described in [BMIDE], and a disk supports DMA, sectors are
+   moved by DMA, so that the CPU can run other threads during the
+   transfer.  Otherwise they are moved by PIO.
+
+   Block requests are asynchronous.  Each channel works on one
+   request at a time and queues requests for its other disk
+   behind it.  The interrupt handler moves each request along,
+   completes it, and starts the next one, so no thread waits on
+   the channel. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -30,10 +44,25 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses, relative to the channel's
+   bus master base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
+
+/* Bus Master Command Register bits. */
+#define BMC_START 0x01          /* Start transfer. */
+#define BMC_READ 0x08           /* Transfer from disk to memory. */
+
+/* Bus Master Status Register bits.  Writing 1 clears them. */
+#define BMS_ERR 0x02            /* Transfer failed. */
+#define BMS_IRQ 0x04            /* Disk raised its interrupt. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -47,8 +76,25 @@
    Many more are defined but this is the small subset that we
    use. */
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
-#define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
-#define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR(S) with retries. */
+#define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR(S) with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* A physical region descriptor, which tells the bus master where
+   in physical memory one piece of a DMA transfer goes.  A piece
+   may not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes, 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last descriptor. */
+  };
+
+#define PRD_EOT 0x8000          /* End of table. */
+
+/* Number of descriptors in a channel's PRD table. */
+#define PRD_CNT 8
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +103,10 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    bool dma;                   /* Transfer sectors by DMA? */
+
+    struct block_request *request;  /* Request waiting or in progress. */
+    struct list_elem elem;      /* Element in channel's waiting list. */
   };
 
 /* An ATA channel (aka controller).
@@ -67,11 +117,19 @@ struct channel
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
 
-    struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    struct ata_disk *active;    /* Disk whose request is in progress. */
+    size_t sectors_done;        /* Sectors of it moved so far by PIO. */
+    bool dma_active;            /* Is it being moved by DMA instead? */
+    struct list waiting;        /* Disks whose requests wait their turn. */
+
+    uint16_t bm_base;           /* Bus master base I/O port, 0 if none. */
+    struct prd prdt[PRD_CNT]    /* Bus master PRD table. */
+      __attribute__ ((aligned (sizeof (struct prd) * PRD_CNT)));
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -81,17 +139,27 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+static uint16_t find_bus_master (void);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sectors (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
+static bool use_dma (const struct ata_disk *, const void *buffer);
+static void start_dma (struct ata_disk *);
+static void finish_dma (struct ata_disk *);
+
+static void begin_request (struct ata_disk *);
+static void continue_request (struct channel *);
+static void end_request (struct channel *);
+static void output_next_sector (struct ata_disk *);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
+static bool poll_while_busy (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
@@ -101,6 +169,7 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -123,9 +192,11 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->active = NULL;
+      list_init (&c->waiting);
+      c->bm_base = bm_base != 0 ? bm_base + chan_no * 8 : 0;
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +207,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->dma = false;
+          d->request = NULL;
         }
 
       /* Register interrupt handler. */
@@ -159,6 +232,27 @@ ide_init (void)
 
 static char *descramble_ata_string (char *, int size);
 
+/* Looks for a PCI bus master IDE controller and, if there is one,
+   enables it and returns the base I/O port of its bus master
+   registers, the primary channel's followed by the secondary's.
+   Returns 0 if there is none, in which case only PIO is used. */
+static uint16_t
+find_bus_master (void)
+{
+  struct pci_dev pci;
+  uint16_t base;
+
+  /* Class 1, subclass 1 is an IDE controller.  Bit 7 of its
+     programming interface says that it can be a bus master. */
+  if (!pci_find_class (0x01, 0x01, &pci) || !(pci.prog_if & 0x80))
+    return 0;
+  base = pci_io_bar (&pci, 4);
+  if (base == 0)
+    return 0;
+  pci_enable_bus_master (&pci);
+  return base;
+}
+
 /* Resets an ATA channel and waits for any devices present on it
    to finish the reset. */
 static void
@@ -284,6 +378,7 @@ identify_ata_device (struct ata_disk *d)
   /* Calculate capacity.
      Read model name and serial number. */
   capacity = *(uint32_t *) &id[60 * 2];
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x100) != 0;
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
   snprintf (extra_info, sizeof extra_info,
@@ -337,63 +432,142 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+/* Starts request R on disk D, or queues it if D's channel is
+   busy with a request for the other disk.  The interrupt handler
+   completes it. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_start (void *d_, struct block_request *r)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  ASSERT (d->request == NULL);
+  d->request = r;
+  if (c->active == NULL)
+    begin_request (d);
+  else
+    list_push_back (&c->waiting, &d->elem);
+  intr_set_level (old_level);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+static struct block_operations ide_operations =
+  {
+    .start = ide_start
+  };
+
+/* Starts disk D's request on D's channel, which must be idle.
+   Must be called with interrupts off. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+begin_request (struct ata_disk *d)
 {
-  struct ata_disk *d = d_;
   struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  struct block_request *r = d->request;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (c->active == NULL);
+
+  c->active = d;
+  c->sectors_done = 0;
+  c->dma_active = use_dma (d, r->buffer);
+  if (c->dma_active)
+    start_dma (d);
+  else
+    {
+      /* For a read, the disk interrupts once per sector as each
+         becomes ready.  For a write, it asks for each sector in
+         turn and interrupts once it has taken it. */
+      select_sectors (d, r->sector, r->cnt);
+      issue_pio_command (c, (r->write
+                             ? CMD_WRITE_SECTOR_RETRY
+                             : CMD_READ_SECTOR_RETRY));
+      if (r->write)
+        output_next_sector (d);
+    }
 }
 
-static struct block_operations ide_operations =
-  {
-    ide_read,
-    ide_write
-  };
+/* Called from the interrupt handler when channel C's disk
+   interrupts during a request.  Moves the next sector by PIO or
+   ends the request. */
+static void
+continue_request (struct channel *c)
+{
+  struct ata_disk *d = c->active;
+  struct block_request *r = d->request;
+  uint8_t *p = (uint8_t *) r->buffer + c->sectors_done * BLOCK_SECTOR_SIZE;
+
+  if (c->dma_active)
+    {
+      finish_dma (d);
+      end_request (c);
+    }
+  else if (!r->write)
+    {
+      if (!poll_while_busy (d))
+        PANIC ("%s: disk read failed, sector=%"PRDSNu,
+               d->name, r->sector + c->sectors_done);
+      input_sector (c, p);
+      if (++c->sectors_done == r->cnt)
+        end_request (c);
+    }
+  else
+    {
+      if (inb (reg_alt_status (c)) & STA_ERR)
+        PANIC ("%s: disk write failed, sector=%"PRDSNu,
+               d->name, r->sector + c->sectors_done);
+      if (++c->sectors_done == r->cnt)
+        end_request (c);
+      else
+        output_next_sector (d);
+    }
+}
+
+/* Ends the request in progress on channel C, starts the next
+   waiting one, if any, and then reports completion. */
+static void
+end_request (struct channel *c)
+{
+  struct ata_disk *d = c->active;
+  struct block_request *r = d->request;
+
+  c->active = NULL;
+  c->expecting_interrupt = false;
+  d->request = NULL;
+  if (!list_empty (&c->waiting))
+    begin_request (list_entry (list_pop_front (&c->waiting),
+                               struct ata_disk, elem));
+  r->complete (r);
+}
+
+/* Waits for disk D to ask for the next sector of the PIO write
+   in progress and sends it. */
+static void
+output_next_sector (struct ata_disk *d)
+{
+  struct channel *c = d->channel;
+  struct block_request *r = d->request;
+
+  if (!poll_while_busy (d))
+    PANIC ("%s: disk write failed, sector=%"PRDSNu,
+           d->name, r->sector + c->sectors_done);
+  output_sector (c, ((uint8_t *) r->buffer
+                     + c->sectors_done * BLOCK_SECTOR_SIZE));
+}
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT, which may be up to 256, to the disk's
+   sector selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sectors (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= 256);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt);      /* 256 is written as 0. */
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -406,10 +580,6 @@ select_sector (struct ata_disk *d, block_sector_t sec_no)
 static void
 issue_pio_command (struct channel *c, uint8_t command) 
 {
-  /* Interrupts must be enabled or our semaphore will never be
-     up'd by the completion handler. */
-  ASSERT (intr_get_level () == INTR_ON);
-
   c->expecting_interrupt = true;
   outb (reg_command (c), command);
 }
@@ -430,6 +600,83 @@ output_sector (struct channel *c, const void *sector)
   outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
 }
 
+/* Returns true if a transfer between disk D and BUFFER can be
+   done by DMA.  The bus master needs BUFFER's physical address,
+   so BUFFER must be in kernel memory, where physical addresses
+   follow from virtual ones, and it must be 2-byte aligned. */
+static bool
+use_dma (const struct ata_disk *d, const void *buffer)
+{
+  return d->dma && is_kernel_vaddr (buffer) && ((uintptr_t) buffer & 1) == 0;
+}
+
+/* Fills in channel C's PRD table to describe the SIZE bytes at
+   kernel virtual address BUFFER, splitting them wherever they
+   cross a 64 kB boundary. */
+static void
+build_prdt (struct channel *c, void *buffer, size_t size)
+{
+  uint32_t addr = vtop (buffer);
+  struct prd *prd;
+
+  for (prd = c->prdt; ; prd++)
+    {
+      size_t chunk = 0x10000 - (addr & 0xffff);
+      if (chunk > size)
+        chunk = size;
+
+      ASSERT (prd < c->prdt + PRD_CNT);
+      prd->addr = addr;
+      prd->size = chunk;
+      prd->flags = 0;
+
+      addr += chunk;
+      size -= chunk;
+      if (size == 0)
+        break;
+    }
+  prd->flags = PRD_EOT;
+}
+
+/* Starts disk D's request as a DMA transfer.  The disk
+   interrupts when it is over. */
+static void
+start_dma (struct ata_disk *d)
+{
+  struct channel *c = d->channel;
+  struct block_request *r = d->request;
+  uint8_t direction = r->write ? 0 : BMC_READ;
+
+  /* Point the bus master at the buffer and clear its old
+     status. */
+  build_prdt (c, r->buffer, r->cnt * BLOCK_SECTOR_SIZE);
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), direction);
+  outb (reg_bm_status (c), inb (reg_bm_status (c)) | BMS_ERR | BMS_IRQ);
+
+  /* Start the disk, then the bus master. */
+  select_sectors (d, r->sector, r->cnt);
+  issue_pio_command (c, r->write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), direction | BMC_START);
+}
+
+/* Stops the bus master after disk D's DMA transfer has
+   interrupted, and checks that it succeeded. */
+static void
+finish_dma (struct ata_disk *d)
+{
+  struct channel *c = d->channel;
+  struct block_request *r = d->request;
+  uint8_t bm_status;
+
+  outb (reg_bm_command (c), r->write ? 0 : BMC_READ);
+  bm_status = inb (reg_bm_status (c));
+  poll_while_busy (d);
+  if ((bm_status & BMS_ERR) || (inb (reg_alt_status (c)) & STA_ERR))
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+           d->name, r->write ? "write" : "read", r->sector);
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
@@ -446,7 +693,7 @@ wait_until_idle (const struct ata_disk *d)
     {
       if ((inb (reg_status (d->channel)) & (STA_BSY | STA_DRQ)) == 0)
         return;
-      timer_usleep (10);
+      timer_udelay (10);
     }
 
   printf ("%s: idle timeout\n", d->name);
@@ -479,6 +726,27 @@ wait_while_busy (const struct ata_disk *d)
   return false;
 }
 
+/* As wait_while_busy(), but spins instead of sleeping, so that
+   it may be used with interrupts off, and gives up after about a
+   second.  Once a command is under way the disk is seldom busy
+   for more than a few microseconds. */
+static bool
+poll_while_busy (const struct ata_disk *d) 
+{
+  struct channel *c = d->channel;
+  int i;
+
+  for (i = 0; i < 100000; i++)
+    {
+      if (!(inb (reg_alt_status (c)) & STA_BSY)) 
+        return (inb (reg_alt_status (c)) & STA_DRQ) != 0;
+      timer_udelay (10);
+    }
+
+  printf ("%s: busy timeout\n", d->name);
+  return false;
+}
+
 /* Program D's channel so that D is now the selected disk. */
 static void
 select_device (const struct ata_disk *d)
@@ -489,7 +757,7 @@ select_device (const struct ata_disk *d)
     dev |= DEV_DEV;
   outb (reg_device (c), dev);
   inb (reg_alt_status (c));
-  timer_nsleep (400);
+  timer_ndelay (400);
 }
 
 /* Select disk D in its channel, as select_device(), but wait for
@@ -514,7 +782,10 @@ interrupt_handler (struct intr_frame *f)
         if (c->expecting_interrupt) 
           {
             inb (reg_status (c));               /* Acknowledge interrupt. */
-            sema_up (&c->completion_wait);      /* Wake up waiter. */
+            if (c->active != NULL)
+              continue_request (c);             /* Move request along. */
+            else
+              sema_up (&c->completion_wait);    /* Wake up waiter. */
           }
         else
           printf ("%s: unexpected interrupt\n", c->name);
@@ -5,12 +5,13 @@
 
 /* Stores keys from the keyboard and serial port. */
 static struct intq buffer;
+static uint8_t buffer_space[INTQ_BUFSIZE];
 
 /* Initializes the input buffer. */
 void
 input_init (void) 
 {
-  intq_init (&buffer);
+  intq_init (&buffer, buffer_space, sizeof buffer_space);
 }
 
 /* Adds a key to the input buffer.
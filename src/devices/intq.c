@@ -2,16 +2,21 @@
 #include <debug.h>
 #include "threads/thread.h"
 
-static int next (int pos);
+static int next (const struct intq *, int pos);
 static void wait (struct intq *q, struct thread **waiter);
 static void signal (struct intq *q, struct thread **waiter);
 
-/* Initializes interrupt queue Q. */
+/* Initializes interrupt queue Q to use the SIZE bytes in BUF,
+   of which it can hold SIZE - 1 at once. */
 void
-intq_init (struct intq *q) 
+intq_init (struct intq *q, uint8_t *buf, int size) 
 {
+  ASSERT (size >= 2);
+
   lock_init (&q->lock);
   q->not_full = q->not_empty = NULL;
+  q->buf = buf;
+  q->size = size;
   q->head = q->tail = 0;
 }
 
@@ -28,7 +33,7 @@ bool
 intq_full (const struct intq *q) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
-  return next (q->head) == q->tail;
+  return next (q, q->head) == q->tail;
 }
 
 /* Removes a byte from Q and returns it.
@@ -49,7 +54,7 @@ intq_getc (struct intq *q)
     }
   
   byte = q->buf[q->tail];
-  q->tail = next (q->tail);
+  q->tail = next (q, q->tail);
   signal (q, &q->not_full);
   return byte;
 }
@@ -70,15 +75,15 @@ intq_putc (struct intq *q, uint8_t byte)
     }
 
   q->buf[q->head] = byte;
-  q->head = next (q->head);
+  q->head = next (q, q->head);
   signal (q, &q->not_empty);
 }
 
-/* Returns the position after POS within an intq. */
+/* Returns the position after POS within Q. */
 static int
-next (int pos) 
+next (const struct intq *q, int pos) 
 {
-  return (pos + 1) % INTQ_BUFSIZE;
+  return (pos + 1) % q->size;
 }
 
 /* WAITER must be the address of Q's not_empty or not_full
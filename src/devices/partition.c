@@ -11,6 +11,7 @@ struct partition
   {
     struct block *block;                /* Underlying block device. */
     block_sector_t start;               /* First sector within device. */
+    struct block_request requests[BLOCK_DEPTH_MAX]; /* Passed to BLOCK. */
   };
 
 static struct block_operations partition_operations;
@@ -171,12 +172,15 @@ found_partition (struct block *block, uint8_t part_type,
       struct partition *p;
       char extra_info[128];
       char name[16];
+      int i;
 
       p = malloc (sizeof *p);
       if (p == NULL)
         PANIC ("Failed to allocate memory for partition descriptor");
       p->block = block;
       p->start = start;
+      for (i = 0; i < BLOCK_DEPTH_MAX; i++)
+        p->requests[i].aux = NULL;
 
       snprintf (name, sizeof name, "%s%d", block_name (block), part_nr);
       snprintf (extra_info, sizeof extra_info, "%s (%02x)",
@@ -298,27 +302,40 @@ partition_type_name (uint8_t type)
   return type_names[type] != NULL ? type_names[type] : "Unknown";
 }
 
-/* Reads sector SECTOR from partition P into BUFFER, which must
-   have room for BLOCK_SECTOR_SIZE bytes. */
+/* Completion function for a request passed on to a
+   partition's underlying device.  Frees the request and
+   completes the partition's own request, which was its AUX. */
 static void
-partition_read (void *p_, block_sector_t sector, void *buffer)
+partition_complete (struct block_request *r)
 {
-  struct partition *p = p_;
-  block_read (p->block, p->start + sector, buffer);
+  struct block_request *orig = r->aux;
+  r->aux = NULL;
+  orig->complete (orig);
 }
 
-/* Write sector SECTOR to partition P from BUFFER, which must
-   contain BLOCK_SECTOR_SIZE bytes.  Returns after the block has
-   acknowledged receiving the data. */
+/* Starts request R on partition P by passing it on, with its
+   sectors translated, to the underlying device.  A request whose
+   AUX is null is free. */
 static void
-partition_write (void *p_, block_sector_t sector, const void *buffer)
+partition_start (void *p_, struct block_request *r)
 {
   struct partition *p = p_;
-  block_write (p->block, p->start + sector, buffer);
+  struct block_request *fwd;
+
+  for (fwd = p->requests; fwd->aux != NULL; fwd++)
+    ASSERT (fwd < p->requests + BLOCK_DEPTH_MAX - 1);
+
+  fwd->sector = p->start + r->sector;
+  fwd->cnt = r->cnt;
+  fwd->buffer = r->buffer;
+  fwd->write = r->write;
+  fwd->complete = partition_complete;
+  fwd->aux = r;
+  block_submit (p->block, fwd);
 }
 
 static struct block_operations partition_operations =
   {
-    partition_read,
-    partition_write
+    .start = partition_start,
+    .depth = BLOCK_DEPTH_MAX
   };
@@ -0,0 +1,164 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include "threads/io.h"
+
+/* This code finds PCI functions and reads and writes their
+   configuration space through configuration mechanism #1, the
+   one that every PC chipset since the 1990s supports.  See
+   [PCI] for details. */
+
+/* I/O port addresses. */
+#define PCI_CONFIG_ADDR 0xcf8   /* Selects a configuration register. */
+#define PCI_CONFIG_DATA 0xcfc   /* Reads or writes the selected register. */
+
+/* Offsets of configuration space registers used only here. */
+#define PCI_REG_ID 0x00         /* Vendor ID (low), device ID (high). */
+#define PCI_REG_CLASS 0x08      /* Revision, prog IF, subclass, class. */
+#define PCI_REG_HEADER 0x0c     /* Header type in bits 16...23. */
+
+/* Header type bit for a device with more than one function. */
+#define PCI_HEADER_MULTI 0x80
+
+static bool find (int vendor_id, int device_id, int class, int subclass,
+                  int index, struct pci_dev *);
+static void select_register (uint8_t bus, uint8_t dev, uint8_t func,
+                             uint8_t reg);
+static uint32_t config_read (uint8_t bus, uint8_t dev, uint8_t func,
+                             uint8_t reg);
+
+/* Searches the PCI buses for a function whose class and subclass
+   codes are CLASS and SUBCLASS.  If one is found, stores it in
+   *PCI and returns true.  Otherwise, returns false. */
+bool
+pci_find_class (uint8_t class, uint8_t subclass, struct pci_dev *pci)
+{
+  return find (-1, -1, class, subclass, 0, pci);
+}
+
+/* Searches the PCI buses for the function with the given
+   VENDOR_ID and DEVICE_ID that comes INDEX'th in bus order,
+   counting from 0.  If there is one, stores it in *PCI and
+   returns true.  Otherwise, returns false. */
+bool
+pci_find_device (uint16_t vendor_id, uint16_t device_id, int index,
+                 struct pci_dev *pci)
+{
+  return find (vendor_id, device_id, -1, -1, index, pci);
+}
+
+/* Searches the PCI buses for the INDEX'th function, counting
+   from 0, whose vendor ID, device ID, class code, and subclass
+   code match VENDOR_ID, DEVICE_ID, CLASS, and SUBCLASS, where -1
+   matches anything.  If there is one, stores it in *PCI and
+   returns true.  Otherwise, returns false. */
+static bool
+find (int vendor_id, int device_id, int class, int subclass, int index,
+      struct pci_dev *pci)
+{
+  int bus, dev, func;
+
+  for (bus = 0; bus < 256; bus++)
+    for (dev = 0; dev < 32; dev++)
+      for (func = 0; func < 8; func++)
+        {
+          uint32_t id = config_read (bus, dev, func, PCI_REG_ID);
+          uint32_t cls;
+
+          if ((id & 0xffff) == 0xffff)
+            {
+              /* No such function.  If function 0 is missing, so
+                 is the whole device. */
+              if (func == 0)
+                break;
+              continue;
+            }
+
+          cls = config_read (bus, dev, func, PCI_REG_CLASS);
+          if ((vendor_id == -1 || (id & 0xffff) == (uint32_t) vendor_id)
+              && (device_id == -1 || (id >> 16) == (uint32_t) device_id)
+              && (class == -1 || (cls >> 24) == (uint32_t) class)
+              && (subclass == -1
+                  || ((cls >> 16) & 0xff) == (uint32_t) subclass)
+              && index-- == 0)
+            {
+              pci->bus = bus;
+              pci->dev = dev;
+              pci->func = func;
+              pci->vendor_id = id & 0xffff;
+              pci->device_id = id >> 16;
+              pci->class = cls >> 24;
+              pci->subclass = (cls >> 16) & 0xff;
+              pci->prog_if = (cls >> 8) & 0xff;
+              return true;
+            }
+
+          if (func == 0
+              && !((config_read (bus, dev, 0, PCI_REG_HEADER) >> 16)
+                   & PCI_HEADER_MULTI))
+            break;
+        }
+  return false;
+}
+
+/* Returns the 32-bit configuration register at byte offset REG
+   of PCI, which must be a multiple of 4. */
+uint32_t
+pci_read_config (const struct pci_dev *pci, uint8_t reg)
+{
+  return config_read (pci->bus, pci->dev, pci->func, reg);
+}
+
+/* Writes VALUE to the 32-bit configuration register at byte
+   offset REG of PCI, which must be a multiple of 4. */
+void
+pci_write_config (const struct pci_dev *pci, uint8_t reg, uint32_t value)
+{
+  select_register (pci->bus, pci->dev, pci->func, reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Returns the I/O port base that PCI's base address register
+   number BAR decodes, or 0 if that register does not map I/O
+   space. */
+uint16_t
+pci_io_bar (const struct pci_dev *pci, int bar)
+{
+  uint32_t value;
+
+  ASSERT (bar >= 0 && bar < 6);
+  value = pci_read_config (pci, PCI_REG_BAR0 + bar * 4);
+  return (value & 1) ? value & 0xfffc : 0;
+}
+
+/* Lets PCI access memory on its own and respond to I/O space
+   accesses. */
+void
+pci_enable_bus_master (const struct pci_dev *pci)
+{
+  /* The upper half of the register is the status register, whose
+     bits are cleared by writing 1s, so write 0s there. */
+  uint32_t command = pci_read_config (pci, PCI_REG_COMMAND) & 0xffff;
+  pci_write_config (pci, PCI_REG_COMMAND,
+                    command | PCI_CMD_IO | PCI_CMD_BUS_MASTER);
+}
+
+/* Makes PCI_CONFIG_DATA access the 32-bit configuration register
+   at byte offset REG of function FUNC of device DEV on bus
+   BUS. */
+static void
+select_register (uint8_t bus, uint8_t dev, uint8_t func, uint8_t reg)
+{
+  ASSERT (reg % 4 == 0);
+  outl (PCI_CONFIG_ADDR, (0x80000000u | (bus << 16) | (dev << 11)
+                          | (func << 8) | reg));
+}
+
+/* Reads the 32-bit configuration register at byte offset REG of
+   function FUNC of device DEV on bus BUS.  Returns all 1-bits if
+   there is no such function. */
+static uint32_t
+config_read (uint8_t bus, uint8_t dev, uint8_t func, uint8_t reg)
+{
+  select_register (bus, dev, func, reg);
+  return inl (PCI_CONFIG_DATA);
+}
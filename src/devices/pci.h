@@ -0,0 +1,37 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A PCI function. */
+struct pci_dev
+  {
+    uint8_t bus;                /* Bus number. */
+    uint8_t dev;                /* Device number on the bus. */
+    uint8_t func;               /* Function number within the device. */
+    uint16_t vendor_id;         /* Vendor ID. */
+    uint16_t device_id;         /* Device ID. */
+    uint8_t class;              /* Base class code. */
+    uint8_t subclass;           /* Subclass code. */
+    uint8_t prog_if;            /* Programming interface. */
+  };
+
+/* Offsets of configuration space registers. */
+#define PCI_REG_COMMAND 0x04    /* Command (16 bits). */
+#define PCI_REG_BAR0 0x10       /* Base address registers, 4 bytes apart. */
+#define PCI_REG_INTERRUPT 0x3c  /* Interrupt line in bits 0...7. */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001       /* Respond to I/O space accesses. */
+#define PCI_CMD_BUS_MASTER 0x0004 /* Allow the device to master the bus. */
+
+bool pci_find_class (uint8_t class, uint8_t subclass, struct pci_dev *);
+bool pci_find_device (uint16_t vendor_id, uint16_t device_id, int index,
+                      struct pci_dev *);
+uint32_t pci_read_config (const struct pci_dev *, uint8_t reg);
+void pci_write_config (const struct pci_dev *, uint8_t reg, uint32_t);
+uint16_t pci_io_bar (const struct pci_dev *, int bar);
+void pci_enable_bus_master (const struct pci_dev *);
+
+#endif /* devices/pci.h */
@@ -0,0 +1,178 @@
+#include "devices/ramdisk.h"
+#include <ctype.h>
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A RAM disk is a block device whose sectors live in pages from
+   the kernel pool.  Transfers are plain memory copies done by the
+   calling thread, so the driver is synchronous. */
+
+/* Sectors per page. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A RAM disk. */
+struct ramdisk
+  {
+    uint8_t **pages;            /* Backing pages. */
+    size_t page_cnt;            /* Number of pages. */
+  };
+
+static struct block_operations ramdisk_operations;
+
+static struct ramdisk *create (size_t page_cnt);
+static void *sector_addr (struct ramdisk *, block_sector_t);
+
+/* Creates a RAM disk named "ram0" as described by SPEC, which is
+   either a size in kB, for an empty (zeroed) disk, or the name of
+   a block device, for a disk that starts out as a copy of that
+   device.  Panics if kernel memory runs out. */
+void
+ramdisk_init (const char *spec)
+{
+  struct ramdisk *rd;
+  struct block *src = NULL;
+  block_sector_t size;
+  char extra_info[128];
+
+  if (isdigit (spec[0]))
+    {
+      size_t kb = atoi (spec);
+      size = DIV_ROUND_UP (kb * 1024, PGSIZE) * SECTORS_PER_PAGE;
+      strlcpy (extra_info, "RAM disk", sizeof extra_info);
+    }
+  else
+    {
+      src = block_get_by_name (spec);
+      if (src == NULL)
+        PANIC ("No such block device \"%s\"", spec);
+      size = block_size (src);
+      snprintf (extra_info, sizeof extra_info, "RAM disk copy of %s", spec);
+    }
+  if (size == 0)
+    PANIC ("RAM disk must not be empty");
+
+  rd = create (DIV_ROUND_UP (size, SECTORS_PER_PAGE));
+
+  /* Preload, a page at a time.  The pages are in kernel memory, so
+     the source's driver can move them by DMA. */
+  if (src != NULL)
+    {
+      block_sector_t sector;
+
+      printf ("ram0: copying %s...\n", spec);
+      for (sector = 0; sector < size; sector += SECTORS_PER_PAGE)
+        {
+          size_t cnt = size - sector;
+          if (cnt > SECTORS_PER_PAGE)
+            cnt = SECTORS_PER_PAGE;
+          block_read_multiple (src, sector, cnt, sector_addr (rd, sector));
+        }
+    }
+
+  block_register ("ram0", BLOCK_RAW, extra_info, size,
+                  &ramdisk_operations, rd);
+}
+
+/* Returns a new RAM disk backed by PAGE_CNT zeroed pages. */
+static struct ramdisk *
+create (size_t page_cnt)
+{
+  struct ramdisk *rd;
+  size_t i;
+
+  rd = malloc (sizeof *rd);
+  if (rd != NULL)
+    rd->pages = malloc (page_cnt * sizeof *rd->pages);
+  if (rd == NULL || rd->pages == NULL)
+    PANIC ("Failed to allocate memory for RAM disk descriptor");
+  rd->page_cnt = page_cnt;
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      rd->pages[i] = palloc_get_page (PAL_ZERO);
+      if (rd->pages[i] == NULL)
+        PANIC ("Out of kernel memory for RAM disk after %zu kB",
+               i * PGSIZE / 1024);
+    }
+  return rd;
+}
+
+/* Returns the address of sector SECTOR of RD. */
+static void *
+sector_addr (struct ramdisk *rd, block_sector_t sector)
+{
+  ASSERT (sector / SECTORS_PER_PAGE < rd->page_cnt);
+  return (rd->pages[sector / SECTORS_PER_PAGE]
+          + sector % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE);
+}
+
+/* Reads CNT sectors starting at SECTOR from RAM disk RD into
+   BUFFER, copying as much of a backing page at once as
+   possible. */
+static void
+ramdisk_read_multiple (void *rd, block_sector_t sector, size_t cnt,
+                       void *buffer)
+{
+  uint8_t *p = buffer;
+
+  while (cnt > 0)
+    {
+      size_t chunk = SECTORS_PER_PAGE - sector % SECTORS_PER_PAGE;
+      if (chunk > cnt)
+        chunk = cnt;
+      memcpy (p, sector_addr (rd, sector), chunk * BLOCK_SECTOR_SIZE);
+      sector += chunk;
+      cnt -= chunk;
+      p += chunk * BLOCK_SECTOR_SIZE;
+    }
+}
+
+/* Writes CNT sectors starting at SECTOR to RAM disk RD from
+   BUFFER, copying as much of a backing page at once as
+   possible. */
+static void
+ramdisk_write_multiple (void *rd, block_sector_t sector, size_t cnt,
+                        const void *buffer)
+{
+  const uint8_t *p = buffer;
+
+  while (cnt > 0)
+    {
+      size_t chunk = SECTORS_PER_PAGE - sector % SECTORS_PER_PAGE;
+      if (chunk > cnt)
+        chunk = cnt;
+      memcpy (sector_addr (rd, sector), p, chunk * BLOCK_SECTOR_SIZE);
+      sector += chunk;
+      cnt -= chunk;
+      p += chunk * BLOCK_SECTOR_SIZE;
+    }
+}
+
+/* Reads sector SECTOR from RAM disk RD into BUFFER. */
+static void
+ramdisk_read (void *rd, block_sector_t sector, void *buffer)
+{
+  memcpy (buffer, sector_addr (rd, sector), BLOCK_SECTOR_SIZE);
+}
+
+/* Writes sector SECTOR to RAM disk RD from BUFFER. */
+static void
+ramdisk_write (void *rd, block_sector_t sector, const void *buffer)
+{
+  memcpy (sector_addr (rd, sector), buffer, BLOCK_SECTOR_SIZE);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    .read = ramdisk_read,
+    .write = ramdisk_write,
+    .read_multiple = ramdisk_read_multiple,
+    .write_multiple = ramdisk_write_multiple
+  };
@@ -37,6 +37,18 @@
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
 
+/* Interrupt Identification Register bits. */
+#define IIR_FIFO 0xc0           /* FIFOs enabled and working. */
+
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable FIFOs. */
+#define FCR_CLEAR_RECV 0x02     /* Clear receive FIFO. */
+#define FCR_CLEAR_XMIT 0x04     /* Clear transmit FIFO. */
+#define FCR_TRIGGER_1 0x00      /* Receive interrupt at 1 byte. */
+
+/* Size of the 16550A's transmit FIFO, in bytes. */
+#define XMIT_FIFO_SIZE 16
+
 /* Line Control Register bits. */
 #define LCR_N81 0x03            /* No parity, 8 data bits, 1 stop bit. */
 #define LCR_DLAB 0x80           /* Divisor Latch Access Bit (DLAB). */
@@ -46,16 +58,26 @@
 
 /* Line Status Register. */
 #define LSR_DR 0x01             /* Data Ready: received data byte is in RBR. */
-#define LSR_THRE 0x20           /* THR Empty. */
+#define LSR_THRE 0x20           /* THR Empty (transmit FIFO empty). */
+#define LSR_TEMT 0x40           /* Transmitter completely idle. */
 
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
+/* Data to be transmitted.  Much bigger than the input buffer, so
+   that a large write fits in it and need not fall back to
+   polling when interrupts are off. */
 static struct intq txq;
+static uint8_t txq_space[4096];
+
+/* Bytes we can write to the UART at once when THR is empty:
+   the size of its transmit FIFO, or 1 if it has none. */
+static int xmit_burst = 1;
 
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
+static void xmit_poll (void);
+static void xmit_fifo (void);
 static void write_ier (void);
 static intr_handler_func serial_interrupt;
 
@@ -68,10 +90,15 @@ init_poll (void)
 {
   ASSERT (mode == UNINIT);
   outb (IER_REG, 0);                    /* Turn off all interrupts. */
-  outb (FCR_REG, 0);                    /* Disable FIFO. */
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR_RECV | FCR_CLEAR_XMIT
+        | FCR_TRIGGER_1);               /* Enable and clear FIFOs. */
+  if ((inb (IIR_REG) & IIR_FIFO) == IIR_FIFO)
+    xmit_burst = XMIT_FIFO_SIZE;
+  else
+    outb (FCR_REG, 0);                  /* No working FIFO: disable. */
   set_serial (9600);                    /* 9.6 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
-  intq_init (&txq);
+  intq_init (&txq, txq_space, sizeof txq_space);
   mode = POLL;
 } 
 
@@ -94,6 +121,29 @@ serial_init_queue (void)
   intr_set_level (old_level);
 }
 
+/* Changes the serial port's speed to BPS bits per second, after
+   sending anything already queued at the old speed.  Returns
+   false without changing anything if BPS is not a rate the
+   16550A can produce exactly, from 300 to 115,200 bps. */
+bool
+serial_set_bps (int bps)
+{
+  enum intr_level old_level;
+
+  if (bps < 300 || bps > 115200 || 115200 % bps != 0)
+    return false;
+
+  old_level = intr_disable ();
+  if (mode == UNINIT)
+    init_poll ();
+  serial_flush ();
+  while ((inb (LSR_REG) & LSR_TEMT) == 0)
+    continue;
+  set_serial (bps);
+  intr_set_level (old_level);
+  return true;
+}
+
 /* Sends BYTE to the serial port. */
 void
 serial_putc (uint8_t byte) 
@@ -117,9 +167,9 @@ serial_putc (uint8_t byte)
           /* Interrupts are off and the transmit queue is full.
              If we wanted to wait for the queue to empty,
              we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-          putc_poll (intq_getc (&txq)); 
+             That's impolite, so we'll send a burst of
+             characters via polling instead. */
+          xmit_poll (); 
         }
 
       intq_putc (&txq, byte); 
@@ -129,6 +179,43 @@ serial_putc (uint8_t byte)
   intr_set_level (old_level);
 }
 
+/* Sends the N bytes in BUFFER to the serial port, like
+   serial_putc() but turning off interrupts only once. */
+void
+serial_putbuf (const uint8_t *buffer, size_t n) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (mode != QUEUE)
+    {
+      if (mode == UNINIT)
+        init_poll ();
+      while (n-- > 0)
+        putc_poll (*buffer++);
+    }
+  else 
+    {
+      while (n-- > 0)
+        {
+          if (intq_full (&txq))
+            {
+              /* Send a burst by polling, as in serial_putc(), if
+                 interrupts are off.  Otherwise intq_putc() will
+                 sleep until the interrupt handler makes room,
+                 so make sure it is enabled. */
+              if (old_level == INTR_OFF)
+                xmit_poll ();
+              else
+                write_ier ();
+            }
+          intq_putc (&txq, *buffer++);
+        }
+      write_ier ();
+    }
+
+  intr_set_level (old_level);
+}
+
 /* Flushes anything in the serial buffer out the port in polling
    mode. */
 void
@@ -136,7 +223,7 @@ serial_flush (void)
 {
   enum intr_level old_level = intr_disable ();
   while (!intq_empty (&txq))
-    putc_poll (intq_getc (&txq));
+    xmit_poll ();
   intr_set_level (old_level);
 }
 
@@ -205,6 +292,31 @@ putc_poll (uint8_t byte)
   outb (THR_REG, byte);
 }
 
+/* Polls the serial port until it's ready, and then transmits a
+   burst of bytes from the transmit queue, which must not be
+   empty. */
+static void
+xmit_poll (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!intq_empty (&txq));
+
+  while ((inb (LSR_REG) & LSR_THRE) == 0)
+    continue;
+  xmit_fifo ();
+}
+
+/* Moves as many bytes from the transmit queue into the UART as
+   its transmit FIFO holds.  THR must be empty. */
+static void
+xmit_fifo (void) 
+{
+  int i;
+
+  for (i = 0; i < xmit_burst && !intq_empty (&txq); i++)
+    outb (THR_REG, intq_getc (&txq));
+}
+
 /* Serial interrupt handler. */
 static void
 serial_interrupt (struct intr_frame *f UNUSED) 
@@ -218,10 +330,10 @@ serial_interrupt (struct intr_frame *f UNUSED)
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+  /* If we have bytes to transmit and the transmit FIFO has
+     drained, refill it in one burst. */
+  if (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
+    xmit_fifo ();
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
@@ -0,0 +1,157 @@
+#include "devices/stripe.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+
+/* A striped block device spreads its sectors across several
+   member block devices in chunks of STRIPE_SECTORS sectors: the
+   first chunk on the first member, the second chunk on the
+   second member, and so on, round robin.  A request that covers
+   several chunks is split into one piece per chunk and the
+   pieces are submitted to the members all at once, so members on
+   different IDE channels (e.g. hdb and hdc) work on it in
+   parallel.  The members' request queues merge pieces that are
+   adjacent on the member. */
+
+/* Sectors per chunk: one page, so that a swap slot lies on a
+   single member. */
+#define STRIPE_SECTORS 8
+
+/* Maximum number of members. */
+#define STRIPE_MAX 4
+
+/* Most chunks that one request can touch. */
+#define PIECE_CNT (BLOCK_MULTIPLE_MAX / STRIPE_SECTORS + 1)
+
+/* A striped block device. */
+struct stripe
+  {
+    struct block *members[STRIPE_MAX];  /* Member devices. */
+    size_t member_cnt;                  /* Number of members. */
+
+    struct block_request *request;      /* Request in progress. */
+    size_t pending;                     /* Its pieces not yet done. */
+    struct block_request pieces[PIECE_CNT];
+  };
+
+static struct block_operations stripe_operations;
+
+/* Creates a block device named "stripe" that stripes across the
+   block devices in NAMES, a comma-separated list of 2 to
+   STRIPE_MAX device names.  NAMES is modified.  The members
+   should not be used for anything else. */
+void
+stripe_init (char *names)
+{
+  struct stripe *s;
+  block_sector_t member_size = 0;
+  char extra_info[128];
+  char *name, *save_ptr;
+  size_t i;
+
+  s = malloc (sizeof *s);
+  if (s == NULL)
+    PANIC ("Failed to allocate memory for stripe descriptor");
+  s->member_cnt = 0;
+  s->request = NULL;
+
+  strlcpy (extra_info, "striped across", sizeof extra_info);
+  for (name = strtok_r (names, ",", &save_ptr); name != NULL;
+       name = strtok_r (NULL, ",", &save_ptr))
+    {
+      struct block *block = block_get_by_name (name);
+      block_sector_t size;
+
+      if (block == NULL)
+        PANIC ("No such block device \"%s\"", name);
+      if (s->member_cnt >= STRIPE_MAX)
+        PANIC ("Cannot stripe across more than %d devices", STRIPE_MAX);
+      for (i = 0; i < s->member_cnt; i++)
+        if (s->members[i] == block)
+          PANIC ("%s: listed twice in stripe", name);
+
+      size = block_size (block) / STRIPE_SECTORS * STRIPE_SECTORS;
+      if (s->member_cnt == 0 || size < member_size)
+        member_size = size;
+      s->members[s->member_cnt++] = block;
+      strlcat (extra_info, " ", sizeof extra_info);
+      strlcat (extra_info, name, sizeof extra_info);
+    }
+  if (s->member_cnt < 2)
+    PANIC ("Stripe needs at least 2 devices");
+
+  block_register ("stripe", BLOCK_RAW, extra_info,
+                  member_size * s->member_cnt, &stripe_operations, s);
+}
+
+/* Completion function for the pieces of a striped device's
+   request.  Completes the request when its last piece is done.
+   Pieces on different IDE channels complete in different
+   interrupt handlers. */
+static void
+piece_done (struct block_request *piece)
+{
+  struct stripe *s = piece->aux;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  ASSERT (s->pending > 0);
+  if (--s->pending == 0)
+    {
+      struct block_request *r = s->request;
+      s->request = NULL;
+      r->complete (r);
+    }
+  intr_set_level (old_level);
+}
+
+/* Starts request R on striped device S by splitting it into one
+   piece per chunk and submitting each to its member. */
+static void
+stripe_start (void *s_, struct block_request *r)
+{
+  struct stripe *s = s_;
+  struct block *targets[PIECE_CNT];
+  block_sector_t sector = r->sector;
+  uint8_t *buffer = r->buffer;
+  size_t left = r->cnt;
+  size_t piece_cnt = 0;
+  size_t i;
+
+  ASSERT (s->request == NULL);
+
+  while (left > 0)
+    {
+      block_sector_t chunk = sector / STRIPE_SECTORS;
+      size_t ofs = sector % STRIPE_SECTORS;
+      size_t cnt = STRIPE_SECTORS - ofs < left ? STRIPE_SECTORS - ofs : left;
+      struct block_request *p = &s->pieces[piece_cnt];
+
+      targets[piece_cnt++] = s->members[chunk % s->member_cnt];
+      p->sector = chunk / s->member_cnt * STRIPE_SECTORS + ofs;
+      p->cnt = cnt;
+      p->buffer = buffer;
+      p->write = r->write;
+      p->complete = piece_done;
+      p->aux = s;
+
+      sector += cnt;
+      buffer += cnt * BLOCK_SECTOR_SIZE;
+      left -= cnt;
+    }
+
+  /* Count every piece before submitting any, because a piece may
+     complete before the next one is submitted. */
+  s->request = r;
+  s->pending = piece_cnt;
+  for (i = 0; i < piece_cnt; i++)
+    block_submit (targets[i], &s->pieces[i]);
+}
+
+static struct block_operations stripe_operations =
+  {
+    .start = stripe_start
+  };
@@ -26,12 +26,33 @@ static size_t cx, cy;
    The attribute at (x,y) is fb[y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
+/* Shadow copy of the screen, in which output is composed before
+   it is copied to the framebuffer, once per batch of characters.
+   The rows form a ring: screen row Y is shadow[row (Y)], so that
+   scrolling just advances TOP instead of moving every row. */
+static uint8_t shadow[ROW_CNT][COL_CNT][2];
+static size_t top;
+
+/* Screen positions, as x + y * COL_CNT, from DIRTY_START up to
+   DIRTY_END are ones whose shadow differs from the framebuffer. */
+static size_t dirty_start, dirty_end;
+
+static void put_char (int c, enum intr_level);
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
+static void mark_dirty (size_t start, size_t end);
+static void flush (void);
 static void move_cursor (void);
 static void find_cursor (size_t *x, size_t *y);
 
+/* Returns the index in shadow[] of screen row Y. */
+static inline size_t
+row (size_t y) 
+{
+  return (top + y) % ROW_CNT;
+}
+
 /* Initializes the VGA text display. */
 static void
 init (void)
@@ -41,6 +62,7 @@ init (void)
   if (!inited)
     {
       fb = ptov (0xb8000);
+      memcpy (shadow, fb, sizeof shadow);
       find_cursor (&cx, &cy);
       inited = true; 
     }
@@ -56,7 +78,36 @@ vga_putc (int c)
   enum intr_level old_level = intr_disable ();
 
   init ();
-  
+  put_char (c, old_level);
+  flush ();
+  move_cursor ();
+
+  intr_set_level (old_level);
+}
+
+/* Writes the N characters in BUFFER to the VGA text display,
+   like vga_putc() but updating the screen only once. */
+void
+vga_putbuf (const char *buffer, size_t n) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  init ();
+  while (n-- > 0)
+    put_char (*buffer++, old_level);
+  flush ();
+  move_cursor ();
+
+  intr_set_level (old_level);
+}
+
+/* Writes C to the shadow screen.  Interrupts must be off; they
+   are turned back on to OLD_LEVEL only while beeping. */
+static void
+put_char (int c, enum intr_level old_level) 
+{
+  size_t pos;
+
   switch (c) 
     {
     case '\n':
@@ -89,17 +140,14 @@ vga_putc (int c)
       break;
       
     default:
-      fb[cy][cx][0] = c;
-      fb[cy][cx][1] = GRAY_ON_BLACK;
+      shadow[row (cy)][cx][0] = c;
+      shadow[row (cy)][cx][1] = GRAY_ON_BLACK;
+      pos = cx + cy * COL_CNT;
+      mark_dirty (pos, pos + 1);
       if (++cx >= COL_CNT)
         newline ();
       break;
     }
-
-  /* Update cursor position. */
-  move_cursor ();
-
-  intr_set_level (old_level);
 }
 
 /* Clears the screen and moves the cursor to the upper left. */
@@ -112,10 +160,9 @@ cls (void)
     clear_row (y);
 
   cx = cy = 0;
-  move_cursor ();
 }
 
-/* Clears row Y to spaces. */
+/* Clears screen row Y to spaces. */
 static void
 clear_row (size_t y) 
 {
@@ -123,9 +170,10 @@ clear_row (size_t y)
 
   for (x = 0; x < COL_CNT; x++)
     {
-      fb[y][x][0] = ' ';
-      fb[y][x][1] = GRAY_ON_BLACK;
+      shadow[row (y)][x][0] = ' ';
+      shadow[row (y)][x][1] = GRAY_ON_BLACK;
     }
+  mark_dirty (y * COL_CNT, (y + 1) * COL_CNT);
 }
 
 /* Advances the cursor to the first column in the next line on
@@ -139,9 +187,49 @@ newline (void)
   if (cy >= ROW_CNT)
     {
       cy = ROW_CNT - 1;
-      memmove (&fb[0], &fb[1], sizeof fb[0] * (ROW_CNT - 1));
+      top = row (1);
       clear_row (ROW_CNT - 1);
+      mark_dirty (0, ROW_CNT * COL_CNT);
+    }
+}
+
+/* Notes that screen positions START up to END have changed in
+   the shadow. */
+static void
+mark_dirty (size_t start, size_t end) 
+{
+  if (dirty_start == dirty_end)
+    {
+      dirty_start = start;
+      dirty_end = end;
+    }
+  else
+    {
+      if (start < dirty_start)
+        dirty_start = start;
+      if (end > dirty_end)
+        dirty_end = end;
+    }
+}
+
+/* Copies the changed part of the shadow to the framebuffer. */
+static void
+flush (void) 
+{
+  size_t pos = dirty_start;
+
+  while (pos < dirty_end)
+    {
+      size_t x = pos % COL_CNT;
+      size_t y = pos / COL_CNT;
+      size_t cnt = COL_CNT - x;
+      if (cnt > dirty_end - pos)
+        cnt = dirty_end - pos;
+
+      memcpy (&fb[y][x], &shadow[row (y)][x], cnt * sizeof fb[y][x]);
+      pos += cnt;
     }
+  dirty_start = dirty_end = 0;
 }
 
 /* Moves the hardware cursor to (cx,cy). */
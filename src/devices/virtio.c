@@ -0,0 +1,335 @@
+#include "devices/virtio.h"
+#include <debug.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The code in this file drives virtio block devices, as emulated
+   by QEMU, through the "legacy" PCI interface described in
+   [VIRTIO].  Compared with an emulated IDE disk, which costs an
+   exit to the emulator for every 16-bit word moved by PIO, a
+   virtio disk costs one exit per request.
+
+   Each disk has a single virtqueue.  Up to BLOCK_DEPTH_MAX
+   requests are in the queue at once, each described by a chain
+   of three descriptors: the request header, the data, and a
+   status byte that the device fills in.  The device interrupts
+   when it has put completed requests in the queue's used ring. */
+
+/* PCI vendor and device ID of a legacy virtio block device. */
+#define VIRTIO_VENDOR_ID 0x1af4
+#define VIRTIO_BLK_DEVICE_ID 0x1001
+
+/* Legacy virtio I/O port addresses. */
+#define reg_features(DISK) ((DISK)->io_base + 0x00)   /* Device features. */
+#define reg_guest_features(DISK) ((DISK)->io_base + 0x04) /* Driver's. */
+#define reg_queue_pfn(DISK) ((DISK)->io_base + 0x08)  /* Queue page number. */
+#define reg_queue_size(DISK) ((DISK)->io_base + 0x0c) /* Queue size (r/o). */
+#define reg_queue_sel(DISK) ((DISK)->io_base + 0x0e)  /* Queue select. */
+#define reg_queue_notify(DISK) ((DISK)->io_base + 0x10) /* Queue notify. */
+#define reg_status(DISK) ((DISK)->io_base + 0x12)     /* Device status. */
+#define reg_isr(DISK) ((DISK)->io_base + 0x13)        /* ISR status. */
+#define reg_capacity(DISK) ((DISK)->io_base + 0x14)   /* Size in sectors. */
+
+/* Device status bits. */
+#define STATUS_ACKNOWLEDGE 0x01 /* Guest has noticed the device. */
+#define STATUS_DRIVER 0x02      /* Guest knows how to drive it. */
+#define STATUS_DRIVER_OK 0x04   /* Driver is ready. */
+
+/* ISR status bits.  Reading the register clears them. */
+#define ISR_QUEUE 0x01          /* Used ring was updated. */
+
+/* A virtqueue descriptor. */
+struct vring_desc
+  {
+    uint64_t addr;              /* Physical address. */
+    uint32_t len;               /* Length in bytes. */
+    uint16_t flags;             /* VRING_DESC_F_* flags. */
+    uint16_t next;              /* Next descriptor in chain. */
+  };
+
+#define VRING_DESC_F_NEXT 0x01  /* NEXT is valid. */
+#define VRING_DESC_F_WRITE 0x02 /* Device writes (vs. reads) buffer. */
+
+/* The available ring, through which the driver hands descriptor
+   chains to the device. */
+struct vring_avail
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the next entry goes, mod size. */
+    uint16_t ring[];            /* Heads of descriptor chains. */
+  };
+
+/* The used ring, through which the device hands them back. */
+struct vring_used_elem
+  {
+    uint32_t id;                /* Head of descriptor chain. */
+    uint32_t len;               /* Bytes written by the device. */
+  };
+
+struct vring_used
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the next entry goes, mod size. */
+    struct vring_used_elem ring[];
+  };
+
+/* Block request header. */
+struct virtio_blk_hdr
+  {
+    uint32_t type;              /* VIRTIO_BLK_T_*. */
+    uint32_t reserved;
+    uint64_t sector;            /* First sector. */
+  };
+
+#define VIRTIO_BLK_T_IN 0       /* Read. */
+#define VIRTIO_BLK_T_OUT 1      /* Write. */
+#define VIRTIO_BLK_S_OK 0       /* Status of a successful request. */
+
+/* Descriptors per request. */
+#define DESC_PER_REQUEST 3
+
+/* A request slot.  Slot I uses descriptors I * DESC_PER_REQUEST
+   onward. */
+struct slot
+  {
+    struct block_request *request; /* Request in progress, or null. */
+    struct virtio_blk_hdr hdr;  /* Header, read by device. */
+    uint8_t status;             /* Status, written by device. */
+  };
+
+/* A virtio disk. */
+struct virtio_disk
+  {
+    char name[8];               /* Name, e.g. "vda". */
+    uint16_t io_base;           /* Base I/O port. */
+    uint8_t irq;                /* Interrupt in use. */
+
+    uint16_t queue_size;        /* Entries in each ring. */
+    struct vring_desc *desc;    /* Descriptor table. */
+    struct vring_avail *avail;  /* Available ring. */
+    struct vring_used *used;    /* Used ring. */
+    uint16_t used_idx;          /* Next used ring entry to look at. */
+
+    struct slot slots[BLOCK_DEPTH_MAX];
+  };
+
+/* We support up to DISK_MAX virtio disks. */
+#define DISK_MAX 4
+static struct virtio_disk disks[DISK_MAX];
+static size_t disk_cnt;
+
+static struct block_operations virtio_operations;
+
+static bool init_disk (struct virtio_disk *, const struct pci_dev *);
+static void interrupt_handler (struct intr_frame *);
+
+/* Detects virtio disks and registers them as block devices
+   named vda, vdb, and so on. */
+void
+virtio_init (void)
+{
+  struct pci_dev pci;
+  int index;
+
+  for (index = 0;
+       disk_cnt < DISK_MAX
+         && pci_find_device (VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID, index,
+                             &pci);
+       index++)
+    {
+      struct virtio_disk *d = &disks[disk_cnt];
+      struct block *block;
+      uint64_t capacity;
+
+      snprintf (d->name, sizeof d->name, "vd%c", 'a' + (int) disk_cnt);
+      if (!init_disk (d, &pci))
+        continue;
+
+      /* The interrupt handler only looks at the first disk_cnt
+         disks, so count D before reading its partition table. */
+      disk_cnt++;
+      capacity = (inl (reg_capacity (d))
+                  | (uint64_t) inl (reg_capacity (d) + 4) << 32);
+      if (capacity > (block_sector_t) -1)
+        capacity = (block_sector_t) -1;
+      block = block_register (d->name, BLOCK_RAW, "virtio", capacity,
+                              &virtio_operations, d);
+      partition_scan (block);
+    }
+}
+
+/* Returns the number of pages needed for a virtqueue with SIZE
+   entries in each ring, laid out as the legacy interface
+   requires: the descriptor table and available ring, then the
+   used ring on the next page boundary. */
+static size_t
+queue_pages (uint16_t size)
+{
+  size_t first = (sizeof (struct vring_desc) * size
+                  + sizeof (struct vring_avail)
+                  + sizeof (uint16_t) * (size + 1));
+  size_t second = (sizeof (struct vring_used)
+                   + sizeof (struct vring_used_elem) * size
+                   + sizeof (uint16_t));
+  return DIV_ROUND_UP (first, PGSIZE) + DIV_ROUND_UP (second, PGSIZE);
+}
+
+/* Resets and sets up the virtio disk at PCI as D.  Returns false
+   if D cannot be used. */
+static bool
+init_disk (struct virtio_disk *d, const struct pci_dev *pci)
+{
+  uint8_t line;
+  uint8_t *queue;
+  size_t desc_size, avail_size;
+  int i;
+
+  d->io_base = pci_io_bar (pci, 0);
+  line = pci_read_config (pci, PCI_REG_INTERRUPT) & 0xff;
+  if (d->io_base == 0 || line >= 16)
+    {
+      printf ("%s: unusable PCI configuration, ignoring\n", d->name);
+      return false;
+    }
+  d->irq = line + 0x20;
+  pci_enable_bus_master (pci);
+
+  /* Reset the device and tell it that we are driving it.  We
+     need no optional features. */
+  outb (reg_status (d), 0);
+  outb (reg_status (d), STATUS_ACKNOWLEDGE);
+  outb (reg_status (d), STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+  inl (reg_features (d));
+  outl (reg_guest_features (d), 0);
+
+  /* Set up queue 0. */
+  outw (reg_queue_sel (d), 0);
+  d->queue_size = inw (reg_queue_size (d));
+  if (d->queue_size < DESC_PER_REQUEST * BLOCK_DEPTH_MAX)
+    {
+      printf ("%s: queue too small, ignoring\n", d->name);
+      return false;
+    }
+  queue = palloc_get_multiple (PAL_ZERO, queue_pages (d->queue_size));
+  if (queue == NULL)
+    PANIC ("%s: out of memory for virtqueue", d->name);
+  desc_size = sizeof (struct vring_desc) * d->queue_size;
+  avail_size = (sizeof (struct vring_avail)
+                + sizeof (uint16_t) * (d->queue_size + 1));
+  d->desc = (struct vring_desc *) queue;
+  d->avail = (struct vring_avail *) (queue + desc_size);
+  d->used = (struct vring_used *) (queue + ROUND_UP (desc_size + avail_size,
+                                                     PGSIZE));
+  d->used_idx = 0;
+  for (i = 0; i < BLOCK_DEPTH_MAX; i++)
+    d->slots[i].request = NULL;
+  outl (reg_queue_pfn (d), vtop (queue) >> PGBITS);
+
+  /* Share the interrupt line with other virtio disks, if any, and
+     then start the device. */
+  for (i = 0; disks + i < d; i++)
+    if (disks[i].irq == d->irq)
+      break;
+  if (disks + i == d)
+    intr_register_ext (d->irq, interrupt_handler, "virtio");
+  outb (reg_status (d),
+        STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+  return true;
+}
+
+/* Fills in descriptor IDX of disk D. */
+static void
+set_desc (struct virtio_disk *d, int idx, void *buffer, size_t size,
+          uint16_t flags)
+{
+  struct vring_desc *desc = &d->desc[idx];
+  desc->addr = vtop (buffer);
+  desc->len = size;
+  desc->flags = flags;
+  desc->next = idx + 1;
+}
+
+/* Puts request R in disk D's virtqueue and tells D about it.
+   The interrupt handler completes it. */
+static void
+virtio_start (void *d_, struct block_request *r)
+{
+  struct virtio_disk *d = d_;
+  struct slot *s;
+  int head;
+
+  for (s = d->slots; s->request != NULL; s++)
+    ASSERT (s < d->slots + BLOCK_DEPTH_MAX - 1);
+  s->request = r;
+  s->hdr.type = r->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+  s->hdr.reserved = 0;
+  s->hdr.sector = r->sector;
+  s->status = 0xff;
+
+  head = (s - d->slots) * DESC_PER_REQUEST;
+  set_desc (d, head, &s->hdr, sizeof s->hdr, VRING_DESC_F_NEXT);
+  set_desc (d, head + 1, r->buffer, r->cnt * BLOCK_SECTOR_SIZE,
+            VRING_DESC_F_NEXT | (r->write ? 0 : VRING_DESC_F_WRITE));
+  set_desc (d, head + 2, &s->status, sizeof s->status, VRING_DESC_F_WRITE);
+
+  /* The device may look at the ring as soon as the index moves,
+     so the entry must be in memory first. */
+  d->avail->ring[d->avail->idx % d->queue_size] = head;
+  barrier ();
+  d->avail->idx++;
+  barrier ();
+  outw (reg_queue_notify (d), 0);
+}
+
+static struct block_operations virtio_operations =
+  {
+    .start = virtio_start,
+    .depth = BLOCK_DEPTH_MAX
+  };
+
+/* Completes the requests that disk D has put in its used ring. */
+static void
+complete_requests (struct virtio_disk *d)
+{
+  while (d->used_idx != *(volatile uint16_t *) &d->used->idx)
+    {
+      struct vring_used_elem *e;
+      struct slot *s;
+      struct block_request *r;
+
+      barrier ();
+      e = &d->used->ring[d->used_idx++ % d->queue_size];
+      s = &d->slots[e->id / DESC_PER_REQUEST];
+      r = s->request;
+      ASSERT (r != NULL);
+      if (s->status != VIRTIO_BLK_S_OK)
+        PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+               d->name, r->write ? "write" : "read", r->sector);
+      s->request = NULL;
+      r->complete (r);
+    }
+}
+
+/* Virtio interrupt handler.  The line may be shared, so every
+   disk on it is checked. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  size_t i;
+
+  for (i = 0; i < disk_cnt; i++)
+    {
+      struct virtio_disk *d = &disks[i];
+      if (d->irq == f->vec_no && (inb (reg_isr (d)) & ISR_QUEUE))
+        complete_requests (d);
+    }
+}
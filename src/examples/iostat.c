@@ -0,0 +1,58 @@
+/* iostat.c
+
+   Prints I/O statistics for each block device: requests, bytes,
+   and average queue wait and service time for reads and writes.
+   With "-h" as the first argument, also prints the latency
+   histograms, one line per nonempty log2 bucket of TSC cycles. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+static void
+print_histogram (const char *what, const unsigned hist[BLKSTAT_BUCKETS])
+{
+  int i;
+
+  for (i = 0; i < BLKSTAT_BUCKETS; i++)
+    if (hist[i] > 0)
+      printf ("    %s < 2^%d cycles: %u\n", what, i + 1, hist[i]);
+}
+
+static void
+print_dir (const char *kind, const struct blkstat_dir *d, bool histograms)
+{
+  printf ("  %-5s %8llu reqs %12llu bytes", kind, d->reqs, d->bytes);
+  if (d->reqs > 0)
+    printf (", avg wait %llu, avg service %llu cycles",
+            d->wait / d->reqs, d->service / d->reqs);
+  printf ("\n");
+
+  if (histograms)
+    {
+      print_histogram ("wait", d->wait_hist);
+      print_histogram ("service", d->service_hist);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  bool histograms = argc > 1 && !strcmp (argv[1], "-h");
+  struct blkstat st;
+  int dev;
+
+  for (dev = 0; blkstat (dev, &st); dev++)
+    {
+      unsigned long long reqs = st.read.reqs + st.write.reqs;
+
+      printf ("%s (%s%s): %u sectors", st.name, st.type,
+              st.role ? ", in use" : "", st.size);
+      if (reqs > 0)
+        printf (", %llu%% reads", st.read.reqs * 100 / reqs);
+      printf ("\n");
+      print_dir ("read", &st.read, histograms);
+      print_dir ("write", &st.write, histograms);
+    }
+  return EXIT_SUCCESS;
+}
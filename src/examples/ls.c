@@ -6,7 +6,10 @@
 
    By default, only the name of each file is printed.  If "-l" is
    given as the first argument, the type, size, and inumber of
-   each file is also printed.  This won't work until project 4. */
+   each file is also printed.  This won't work until project 4.
+
+   Entries are fetched with getdents(), many per system call, and
+   file sizes with stat(), without opening each file. */
 
 #include <syscall.h>
 #include <stdio.h>
@@ -24,38 +27,42 @@ list_dir (const char *dir, bool verbose)
 
   if (isdir (dir_fd))
     {
-      char name[READDIR_MAX_LEN];
+      struct dirent ents[16];
+      unsigned cookie = 0;
+      int cnt;
 
       printf ("%s", dir);
       if (verbose)
         printf (" (inumber %d)", inumber (dir_fd));
       printf (":\n");
 
-      while (readdir (dir_fd, name)) 
+      while ((cnt = getdents (dir_fd, cookie, ents, 16)) > 0)
         {
-          printf ("%s", name); 
-          if (verbose) 
-            {
-              char full_name[128];
-              int entry_fd;
+          int i;
 
-              snprintf (full_name, sizeof full_name, "%s/%s", dir, name);
-              entry_fd = open (full_name);
+          for (i = 0; i < cnt; i++)
+            {
+              const struct dirent *e = &ents[i];
 
-              printf (": ");
-              if (entry_fd != -1)
+              printf ("%s", e->d_name);
+              if (verbose && e->d_type == DT_DIR)
+                printf (": directory, inumber %u", e->d_ino);
+              else if (verbose)
                 {
-                  if (isdir (entry_fd))
-                    printf ("directory");
+                  char full_name[128];
+                  struct stat st;
+
+                  snprintf (full_name, sizeof full_name, "%s/%s",
+                            dir, e->d_name);
+                  printf (": ");
+                  if (stat (full_name, &st))
+                    printf ("%d-byte file, inumber %u", st.st_size, e->d_ino);
                   else
-                    printf ("%d-byte file", filesize (entry_fd));
-                  printf (", inumber %d", inumber (entry_fd));
+                    printf ("stat failed");
                 }
-              else
-                printf ("open failed");
-              close (entry_fd);
+              printf ("\n");
             }
-          printf ("\n");
+          cookie = ents[cnt - 1].d_next;
         }
     }
   else 
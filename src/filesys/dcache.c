@@ -0,0 +1,174 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Directory entry cache.
+
+   Maps a (directory inode sector, name) pair to the inode sector
+   that the name refers to, or to DCACHE_NEGATIVE if the
+   directory is known to contain no such name.  Lets repeated
+   lookups of the same names, including names that do not exist,
+   skip searching the directory.
+
+   The directory layer keeps the cache up to date: every
+   successful dir_add() and dir_remove() replaces the entry for
+   the name it changed. */
+
+/* Maximum number of cached names. */
+#define DCACHE_CNT 256
+
+/* A cached name. */
+struct dcache_entry
+  {
+    struct hash_elem hash_elem;         /* Element in dcache. */
+    struct list_elem lru_elem;          /* Element in lru. */
+    block_sector_t dir;                 /* Directory inode sector. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    block_sector_t sector;              /* Inode sector or DCACHE_NEGATIVE. */
+  };
+
+/* Cached names, and the same entries most recently used first. */
+static struct hash dcache;
+static struct list lru;
+
+/* Protects dcache and lru. */
+static struct lock dcache_lock;
+
+/* Returns a hash value for cache entry E_. */
+static unsigned
+dcache_hash (const struct hash_elem *e_, void *aux UNUSED)
+{
+  const struct dcache_entry *e = hash_entry (e_, struct dcache_entry,
+                                             hash_elem);
+  return hash_string (e->name) ^ hash_int (e->dir);
+}
+
+/* Returns true if cache entry A_ precedes cache entry B_. */
+static bool
+dcache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dcache_entry *a = hash_entry (a_, struct dcache_entry,
+                                             hash_elem);
+  const struct dcache_entry *b = hash_entry (b_, struct dcache_entry,
+                                             hash_elem);
+  if (a->dir != b->dir)
+    return a->dir < b->dir;
+  return strcmp (a->name, b->name) < 0;
+}
+
+/* Returns the entry for NAME in DIR, or a null pointer if it is
+   not cached. */
+static struct dcache_entry *
+find (block_sector_t dir, const char *name)
+{
+  struct dcache_entry key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  key.dir = dir;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dcache, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dcache_entry, hash_elem) : NULL;
+}
+
+/* Removes E from the cache and frees it. */
+static void
+discard (struct dcache_entry *e)
+{
+  hash_delete (&dcache, &e->hash_elem);
+  list_remove (&e->lru_elem);
+  free (e);
+}
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void)
+{
+  hash_init (&dcache, dcache_hash, dcache_less, NULL);
+  list_init (&lru);
+  lock_init (&dcache_lock);
+}
+
+/* Looks up NAME in directory DIR.  Returns false if the name is
+   not cached.  Otherwise returns true and stores the name's inode
+   sector, or DCACHE_NEGATIVE if DIR has no entry for NAME, into
+   *SECTORP. */
+bool
+dcache_lookup (block_sector_t dir, const char *name, block_sector_t *sectorp)
+{
+  struct dcache_entry *e;
+
+  lock_acquire (&dcache_lock);
+  e = find (dir, name);
+  if (e != NULL)
+    {
+      list_remove (&e->lru_elem);
+      list_push_front (&lru, &e->lru_elem);
+      *sectorp = e->sector;
+    }
+  lock_release (&dcache_lock);
+  return e != NULL;
+}
+
+/* Records that NAME in directory DIR refers to inode SECTOR, or
+   that it does not exist if SECTOR is DCACHE_NEGATIVE, replacing
+   anything previously cached for NAME.  Names too long to be
+   valid are not cached. */
+void
+dcache_insert (block_sector_t dir, const char *name, block_sector_t sector)
+{
+  struct dcache_entry *e;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  e = find (dir, name);
+  if (e == NULL)
+    {
+      if (hash_size (&dcache) >= DCACHE_CNT)
+        discard (list_entry (list_back (&lru), struct dcache_entry,
+                             lru_elem));
+      e = malloc (sizeof *e);
+      if (e == NULL)
+        goto done;
+      e->dir = dir;
+      strlcpy (e->name, name, sizeof e->name);
+      hash_insert (&dcache, &e->hash_elem);
+    }
+  else
+    list_remove (&e->lru_elem);
+
+  e->sector = sector;
+  list_push_front (&lru, &e->lru_elem);
+
+ done:
+  lock_release (&dcache_lock);
+}
+
+/* Forgets every name cached for directory DIR.  Called when a
+   new directory is created in DIR's sector, which may have
+   belonged to a since-deleted directory. */
+void
+dcache_invalidate_dir (block_sector_t dir)
+{
+  struct list_elem *e, *next;
+
+  lock_acquire (&dcache_lock);
+  for (e = list_begin (&lru); e != list_end (&lru); e = next)
+    {
+      struct dcache_entry *de = list_entry (e, struct dcache_entry,
+                                            lru_elem);
+      next = list_next (e);
+      if (de->dir == dir)
+        discard (de);
+    }
+  lock_release (&dcache_lock);
+}
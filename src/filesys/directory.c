@@ -1,8 +1,13 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <dirent.h>
+#include <hash.h>
+#include <limits.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
@@ -19,23 +24,82 @@ struct dir_entry
     block_sector_t inode_sector;        /* Sector number of header. */
     char name[NAME_MAX + 1];            /* Null terminated file name. */
     bool in_use;                        /* In use or free? */
+    bool is_dir;                        /* Names a directory? */
   };
 
+/* Every operation that reads or changes a directory's entries
+   holds the directory inode's lock (see inode_lock()), which
+   also protects the directory's index.  When two directory
+   locks are needed, the parent's is taken first. */
+
+/* In-memory index of a directory's entries, built the first time
+   the directory is searched and kept attached to its inode (see
+   inode_set_aux()) for as long as the inode stays in memory.
+   Turns lookup, add and remove into hash table operations
+   instead of a scan of the whole directory file. */
+struct dir_index
+  {
+    struct hash entries;                /* In-use entries, by name. */
+    struct list free_slots;             /* Free entries, by offset. */
+    off_t end;                          /* Offset just past last entry. */
+  };
+
+/* An entry in a directory index.
+   Lives in ENTRIES while the slot at OFS is in use, and in
+   FREE_SLOTS while it is free. */
+struct index_entry
+  {
+    struct hash_elem hash_elem;         /* Element in dir_index entries. */
+    struct list_elem list_elem;         /* Element in dir_index free_slots. */
+    off_t ofs;                          /* Byte offset of directory entry. */
+    struct dir_entry e;                 /* Copy of the directory entry. */
+  };
+
+/* Number of directory entries read at a time while building an
+   index. */
+#define INDEX_READ_CNT (BLOCK_SECTOR_SIZE / sizeof (struct dir_entry) * 4)
+
+static struct dir_index *get_index (const struct dir *);
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR, whose parent directory is in sector PARENT.  The
+   directory starts out with "." and ".." entries.
+   Returns true if successful, false on failure.  On failure,
+   SECTOR is released to the free map. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, block_sector_t parent, size_t entry_cnt)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct inode *inode;
+  struct dir *dir;
+  bool success;
+
+  dcache_invalidate_dir (sector);
+  if (!inode_create (sector, entry_cnt * sizeof (struct dir_entry), true))
+    {
+      free_map_release (sector, 1);
+      return false;
+    }
+
+  inode = inode_open (sector);
+  dir = dir_open (inode_reopen (inode));
+  success = (dir != NULL
+             && dir_add (dir, ".", sector, true)
+             && dir_add (dir, "..", parent, true));
+  dir_close (dir);
+  if (!success && inode != NULL)
+    inode_remove (inode);
+  inode_close (inode);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
-   it takes ownership.  Returns a null pointer on failure. */
+   it takes ownership.  Returns a null pointer on failure,
+   including if INODE is not a directory. */
 struct dir *
 dir_open (struct inode *inode) 
 {
   struct dir *dir = calloc (1, sizeof *dir);
-  if (inode != NULL && dir != NULL)
+  if (inode != NULL && dir != NULL && inode_is_dir (inode))
     {
       dir->inode = inode;
       dir->pos = 0;
@@ -83,6 +147,140 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Returns a hash value for index entry E. */
+static unsigned
+index_entry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_string (hash_entry (e, struct index_entry, hash_elem)->e.name);
+}
+
+/* Returns true if index entry A's name precedes index entry B's. */
+static bool
+index_entry_less (const struct hash_elem *a, const struct hash_elem *b,
+                  void *aux UNUSED)
+{
+  return strcmp (hash_entry (a, struct index_entry, hash_elem)->e.name,
+                 hash_entry (b, struct index_entry, hash_elem)->e.name) < 0;
+}
+
+/* Frees index entry E. */
+static void
+index_entry_destroy (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct index_entry, hash_elem));
+}
+
+/* Frees INDEX_, a struct dir_index. */
+static void
+index_destroy (void *index_)
+{
+  struct dir_index *index = index_;
+
+  hash_destroy (&index->entries, index_entry_destroy);
+  while (!list_empty (&index->free_slots))
+    free (list_entry (list_pop_front (&index->free_slots),
+                      struct index_entry, list_elem));
+  free (index);
+}
+
+/* Adds the directory entry E found at offset OFS to INDEX.
+   Returns true if successful, false if out of memory. */
+static bool
+index_insert (struct dir_index *index, const struct dir_entry *e, off_t ofs)
+{
+  struct index_entry *ie = malloc (sizeof *ie);
+  if (ie == NULL)
+    return false;
+  ie->ofs = ofs;
+  ie->e = *e;
+  if (e->in_use)
+    {
+      /* Only the first of any duplicate names is reachable. */
+      if (hash_insert (&index->entries, &ie->hash_elem) != NULL)
+        free (ie);
+    }
+  else
+    list_push_back (&index->free_slots, &ie->list_elem);
+  return true;
+}
+
+/* Reads all of DIR's entries into a new index.
+   Returns the index, or a null pointer if memory is short. */
+static struct dir_index *
+build_index (const struct dir *dir)
+{
+  struct dir_index *index;
+  struct dir_entry *entries;
+  off_t ofs = 0;
+  off_t n;
+
+  index = malloc (sizeof *index);
+  entries = malloc (INDEX_READ_CNT * sizeof *entries);
+  if (index == NULL || entries == NULL
+      || !hash_init (&index->entries, index_entry_hash, index_entry_less,
+                     NULL))
+    {
+      free (index);
+      free (entries);
+      return NULL;
+    }
+  list_init (&index->free_slots);
+
+  /* Read many entries per call instead of one at a time. */
+  while ((n = inode_read_at (dir->inode, entries,
+                             INDEX_READ_CNT * sizeof *entries, ofs)) > 0)
+    {
+      size_t i;
+
+      for (i = 0; i < n / sizeof *entries; i++, ofs += sizeof *entries)
+        if (!index_insert (index, &entries[i], ofs))
+          {
+            free (entries);
+            index_destroy (index);
+            return NULL;
+          }
+      if (n % sizeof *entries != 0)
+        break;
+    }
+  index->end = ofs;
+
+  free (entries);
+  return index;
+}
+
+/* Returns DIR's index, building it if this is the first time
+   that DIR's inode has been searched.  Returns a null pointer if
+   there is not enough memory for an index, in which case callers
+   fall back to scanning the directory.
+   The caller must hold DIR's inode lock. */
+static struct dir_index *
+get_index (const struct dir *dir)
+{
+  struct dir_index *index = inode_get_aux (dir->inode);
+  if (index == NULL)
+    {
+      index = build_index (dir);
+      if (index != NULL)
+        inode_set_aux (dir->inode, index, index_destroy);
+    }
+  return index;
+}
+
+/* Returns the entry for NAME in INDEX, or a null pointer if
+   there is none. */
+static struct index_entry *
+index_find (struct dir_index *index, const char *name)
+{
+  struct index_entry key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  strlcpy (key.e.name, name, sizeof key.e.name);
+  e = hash_find (&index->entries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct index_entry, hash_elem) : NULL;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
@@ -92,12 +290,26 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
+  struct dir_index *index;
   struct dir_entry e;
   size_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  index = get_index (dir);
+  if (index != NULL)
+    {
+      struct index_entry *ie = index_find (index, name);
+      if (ie == NULL)
+        return false;
+      if (ep != NULL)
+        *ep = ie->e;
+      if (ofsp != NULL)
+        *ofsp = ie->ofs;
+      return true;
+    }
+
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
@@ -119,28 +331,47 @@ bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t dir_sector, sector;
   struct dir_entry e;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  /* A removed directory has no entries, not even "." and "..". */
+  *inode = NULL;
+  inode_lock (dir->inode);
+  if (inode_is_removed (dir->inode))
+    goto done;
+
+  dir_sector = inode_get_inumber (dir->inode);
+  if (!dcache_lookup (dir_sector, name, &sector))
+    {
+      sector = lookup (dir, name, &e, NULL) ? e.inode_sector : DCACHE_NEGATIVE;
+      dcache_insert (dir_sector, name, sector);
+    }
+
+  /* Open the inode before unlocking, so that it cannot be
+     removed in between. */
+  if (sector != DCACHE_NEGATIVE)
+    *inode = inode_open (sector);
 
+ done:
+  inode_unlock (dir->inode);
   return *inode != NULL;
 }
 
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
-   INODE_SECTOR.
+   INODE_SECTOR, and it is a directory if IS_DIR is true.
    Returns true if successful, false on failure.
    Fails if NAME is invalid (i.e. too long) or a disk or memory
    error occurs. */
 bool
-dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
+dir_add (struct dir *dir, const char *name, block_sector_t inode_sector,
+         bool is_dir)
 {
+  struct dir_index *index;
+  struct index_entry *slot = NULL;
   struct dir_entry e;
   off_t ofs;
   bool success = false;
@@ -152,10 +383,52 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  inode_lock (dir->inode);
+
+  /* No new entries in a removed directory. */
+  if (inode_is_removed (dir->inode))
+    goto done;
+
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
+  index = get_index (dir);
+  if (index != NULL)
+    {
+      /* Take the first free slot, or append a new one. */
+      if (!list_empty (&index->free_slots))
+        slot = list_entry (list_front (&index->free_slots),
+                           struct index_entry, list_elem);
+      else
+        {
+          slot = malloc (sizeof *slot);
+          if (slot == NULL)
+            goto done;
+          slot->ofs = index->end;
+        }
+
+      slot->e.in_use = true;
+      strlcpy (slot->e.name, name, sizeof slot->e.name);
+      slot->e.inode_sector = inode_sector;
+      slot->e.is_dir = is_dir;
+      success = (inode_write_at (dir->inode, &slot->e, sizeof slot->e,
+                                 slot->ofs) == sizeof slot->e);
+      if (success)
+        {
+          if (slot->ofs == index->end)
+            index->end += sizeof slot->e;
+          else
+            list_remove (&slot->list_elem);
+          hash_insert (&index->entries, &slot->hash_elem);
+        }
+      else if (slot->ofs == index->end)
+        free (slot);
+      else
+        slot->e.in_use = false;
+      goto done;
+    }
+
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
      current end-of-file.
@@ -172,15 +445,71 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
+  e.is_dir = is_dir;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
  done:
+  if (success)
+    dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
+  inode_unlock (dir->inode);
   return success;
 }
 
+/* Moves NAME's entry in DIR's index, if DIR has one, from the
+   in-use entries to the free slots. */
+static void
+index_remove (const struct dir *dir, const char *name)
+{
+  struct dir_index *index = inode_get_aux (dir->inode);
+  struct index_entry *ie;
+  struct list_elem *e;
+
+  if (index == NULL || (ie = index_find (index, name)) == NULL)
+    return;
+  hash_delete (&index->entries, &ie->hash_elem);
+  ie->e.in_use = false;
+
+  /* Keep free slots sorted so that dir_add() reuses the lowest
+     one, as a scan of the directory would. */
+  for (e = list_begin (&index->free_slots); e != list_end (&index->free_slots);
+       e = list_next (e))
+    if (list_entry (e, struct index_entry, list_elem)->ofs > ie->ofs)
+      break;
+  list_insert (e, &ie->list_elem);
+}
+
+/* Returns true if DIR has no entries other than "." and "..".
+   The caller must hold DIR's inode lock. */
+static bool
+dir_is_empty (const struct dir *dir)
+{
+  struct dir_index *index = get_index (dir);
+  struct dir_entry e;
+  off_t ofs;
+
+  if (index != NULL)
+    return hash_size (&index->entries) <= 2;
+
+  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, ".."))
+      return false;
+  return true;
+}
+
+/* Returns true if NAME is "." or "..". */
+static bool
+is_dot_name (const char *name)
+{
+  return !strcmp (name, ".") || !strcmp (name, "..");
+}
+
 /* Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   which occurs if there is no file with the given NAME, if NAME
+   is "." or "..", or if NAME is a directory that is not empty
+   or that is open (including as a process's working
+   directory). */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
@@ -192,8 +521,10 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  inode_lock (dir->inode);
+
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  if (is_dot_name (name) || !lookup (dir, name, &e, &ofs))
     goto done;
 
   /* Open inode. */
@@ -201,36 +532,123 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
+  /* Only remove directories that are empty and not in use.  The
+     victim's lock is held from the emptiness check until it is
+     marked removed, so that nothing can be added to it in
+     between. */
+  if (inode_is_dir (inode))
+    {
+      struct dir victim;
+
+      if (inode_open_cnt (inode) > 1)
+        goto done;
+      victim.inode = inode;
+      victim.pos = 0;
+      inode_lock (inode);
+      if (!dir_is_empty (&victim))
+        {
+          inode_unlock (inode);
+          goto done;
+        }
+    }
+
   /* Erase directory entry. */
   e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
-    goto done;
+  if (inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e)
+    {
+      index_remove (dir, name);
+      dcache_insert (inode_get_inumber (dir->inode), name, DCACHE_NEGATIVE);
 
-  /* Remove inode. */
-  inode_remove (inode);
-  success = true;
+      /* Remove inode. */
+      inode_remove (inode);
+      success = true;
+    }
+  if (inode_is_dir (inode))
+    inode_unlock (inode);
 
  done:
+  inode_unlock (dir->inode);
   inode_close (inode);
   return success;
 }
 
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+   contains no more entries.  Never returns "." or "..".
+   NAME must not be in user memory: a page fault on it would kill
+   the process with DIR still locked. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
+  bool success = false;
 
+  inode_lock (dir->inode);
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
-      if (e.in_use)
+      if (e.in_use && !is_dot_name (e.name))
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          success = true;
+          break;
         } 
     }
-  return false;
+  inode_unlock (dir->inode);
+  return success;
+}
+
+/* Stores up to CNT of DIR's entries in ENTS, starting with entry
+   number *COOKIE, and advances *COOKIE past the last entry
+   stored.  Entries are read from disk many at a time under a
+   single lock of DIR, so listing a directory does not cost one
+   inode_read_at() per entry.  Like dir_readdir(), never stores
+   "." or ".." and must not be given user memory.
+   Returns the number of entries stored, which is 0 once the end
+   of the directory is reached or if memory is short. */
+size_t
+dir_read_entries (struct dir *dir, unsigned *cookie, struct dirent *ents,
+                  size_t cnt)
+{
+  struct dir_entry *entries;
+  size_t stored = 0;
+  off_t ofs;
+  off_t n;
+
+  if (*cookie > INT_MAX / sizeof *entries)
+    return 0;
+  entries = malloc (INDEX_READ_CNT * sizeof *entries);
+  if (entries == NULL)
+    return 0;
+
+  ofs = *cookie * sizeof *entries;
+  inode_lock (dir->inode);
+  while (stored < cnt
+         && (n = inode_read_at (dir->inode, entries,
+                                INDEX_READ_CNT * sizeof *entries, ofs)) > 0)
+    {
+      size_t i;
+
+      for (i = 0; i < n / sizeof *entries && stored < cnt; i++)
+        {
+          const struct dir_entry *e = &entries[i];
+
+          ofs += sizeof *e;
+          if (e->in_use && !is_dot_name (e->name))
+            {
+              struct dirent *d = &ents[stored++];
+              d->d_ino = e->inode_sector;
+              d->d_next = ofs / sizeof *e;
+              d->d_type = e->is_dir ? DT_DIR : DT_REG;
+              strlcpy (d->d_name, e->name, sizeof d->d_name);
+            }
+        }
+      if (n % sizeof *entries != 0)
+        break;
+    }
+  inode_unlock (dir->inode);
+  free (entries);
+
+  *cookie = ofs / sizeof *entries;
+  return stored;
 }
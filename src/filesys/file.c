@@ -2,7 +2,9 @@
 #include <debug.h>
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 #include <list.h>
 
 /* An open file. */
@@ -90,11 +92,10 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
+   Extends the file if the write goes past its end.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
-   Advances FILE's position by the number of bytes read. */
+   which may be less than SIZE if the disk fills up.
+   Advances FILE's position by the number of bytes written. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
 {
@@ -105,10 +106,9 @@ file_write (struct file *file, const void *buffer, off_t size)
 
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at offset FILE_OFS in the file.
+   Extends the file if the write goes past its end.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk fills up.
    The file's current position is unaffected. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
@@ -117,6 +117,84 @@ file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Reads into the CNT buffers described by IOV, in order, from
+   FILE starting at the file's current position, as one
+   transfer.
+   Returns the total number of bytes actually read,
+   which may be less than requested if end of file is reached.
+   Advances FILE's position by the number of bytes read. */
+off_t
+file_readv (struct file *file, const struct iovec *iov, int cnt)
+{
+  off_t bytes_read = inode_readv_at (file->inode, iov, cnt, file->pos);
+  file->pos += bytes_read;
+  return bytes_read;
+}
+
+/* Writes the CNT buffers described by IOV, in order, into FILE
+   starting at the file's current position, as one transfer.
+   Returns the total number of bytes actually written,
+   which may be less than requested if the disk fills up.
+   Advances FILE's position by the number of bytes written. */
+off_t
+file_writev (struct file *file, const struct iovec *iov, int cnt)
+{
+  off_t bytes_written = inode_writev_at (file->inode, iov, cnt, file->pos);
+  file->pos += bytes_written;
+  return bytes_written;
+}
+
+/* Copies up to SIZE bytes from SRC, starting at its current
+   position, into DST at its current position, without the data
+   leaving the kernel.  Data moves a page at a time, so that runs
+   of whole sectors go straight between the disk and the buffer.
+   Returns the number of bytes actually copied, which may be less
+   than SIZE if the end of SRC is reached, DST cannot be written,
+   or memory is short.
+   Advances both files' positions by the number of bytes
+   copied.  DST and SRC must not be the same file. */
+off_t
+file_copy (struct file *dst, struct file *src, off_t size)
+{
+  uint8_t *buffer;
+  off_t bytes_copied = 0;
+
+  ASSERT (dst->inode != src->inode);
+
+  buffer = palloc_get_page (0);
+  if (buffer == NULL)
+    return 0;
+
+  while (bytes_copied < size)
+    {
+      off_t left = size - bytes_copied;
+      off_t chunk = left < PGSIZE ? left : PGSIZE;
+      off_t bytes_read = inode_read_at (src->inode, buffer, chunk, src->pos);
+      off_t bytes_written = inode_write_at (dst->inode, buffer, bytes_read,
+                                            dst->pos);
+
+      src->pos += bytes_written;
+      dst->pos += bytes_written;
+      bytes_copied += bytes_written;
+      if (bytes_written < chunk)
+        break;
+    }
+
+  palloc_free_page (buffer);
+  return bytes_copied;
+}
+
+/* Reserves disk space for the LENGTH bytes of FILE starting at
+   byte OFFSET, extending FILE if they go past its end.  The new
+   bytes read as zeros.  FILE's current position is unaffected.
+   Returns true if successful, false if the disk fills up or
+   writes to FILE are denied. */
+bool
+file_allocate (struct file *file, off_t offset, off_t length)
+{
+  return inode_allocate (file->inode, offset, length);
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
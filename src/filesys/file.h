@@ -5,6 +5,7 @@
 #include <list.h>
 
 struct inode;
+struct iovec;
 
 /* Opening and closing files. */
 struct file *file_open (struct inode *);
@@ -17,6 +18,10 @@ off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
+off_t file_readv (struct file *, const struct iovec *, int cnt);
+off_t file_writev (struct file *, const struct iovec *, int cnt);
+off_t file_copy (struct file *dst, struct file *src, off_t size);
+bool file_allocate (struct file *, off_t offset, off_t length);
 
 /* Preventing writes. */
 void file_deny_write (struct file *);
@@ -1,7 +1,9 @@
 #include "filesys/filesys.h"
 #include <debug.h>
+#include <stat.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
@@ -23,6 +25,7 @@ filesys_init (bool format)
     PANIC ("No file system device found, can't initialize file system.");
 
   inode_init ();
+  dcache_init ();
   free_map_init ();
 
   if (format) 
@@ -39,65 +42,231 @@ filesys_done (void)
   free_map_close ();
 }
 
-/* Creates a file named NAME with the given INITIAL_SIZE.
+/* Opens the directory in which lookups of PATH start: the root
+   directory if PATH is absolute, otherwise the current thread's
+   working directory.  Returns a null pointer on failure. */
+static struct dir *
+open_start_dir (const char *path)
+{
+  struct dir *cwd = thread_current ()->cwd;
+
+  if (path[0] == '/' || cwd == NULL)
+    return dir_open_root ();
+  return dir_reopen (cwd);
+}
+
+/* Resolves every component of PATH but the last.
+   On success, returns true, stores the directory containing the
+   last component into *DIRP, which the caller must close, and
+   copies the last component into NAME.  For a PATH with no last
+   component, such as "/", NAME is set to ".".
+   Returns false if PATH is empty, if a component is too long,
+   or if a directory along the way does not exist. */
+static bool
+resolve_parent (const char *path, struct dir **dirp, char name[NAME_MAX + 1])
+{
+  struct dir *dir;
+  const char *p = path;
+
+  if (*path == '\0')
+    return false;
+
+  dir = open_start_dir (path);
+  if (dir == NULL)
+    return false;
+
+  strlcpy (name, ".", NAME_MAX + 1);
+  for (;;)
+    {
+      const char *start;
+      size_t len;
+
+      /* Find the next component. */
+      while (*p == '/')
+        p++;
+      if (*p == '\0')
+        break;
+      start = p;
+      while (*p != '/' && *p != '\0')
+        p++;
+      len = p - start;
+      if (len > NAME_MAX)
+        goto error;
+
+      /* The previous component, which is not the last, must be
+         a directory. */
+      if (strcmp (name, "."))
+        {
+          struct inode *inode;
+
+          dir_lookup (dir, name, &inode);
+          dir_close (dir);
+          dir = dir_open (inode);
+          if (dir == NULL)
+            return false;
+        }
+      memcpy (name, start, len);
+      name[len] = '\0';
+    }
+
+  *dirp = dir;
+  return true;
+
+ error:
+  dir_close (dir);
+  return false;
+}
+
+/* Creates a file named by PATH with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
-   Fails if a file named NAME already exists,
-   or if internal memory allocation fails. */
+   Fails if a file named by PATH already exists, if a directory
+   in PATH does not exist, or if internal memory allocation
+   fails. */
 bool
-filesys_create (const char *name, off_t initial_size) 
+filesys_create (const char *path, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
+  char name[NAME_MAX + 1];
+  struct dir *dir = NULL;
+  bool success = (resolve_parent (path, &dir, name)
                   && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+                  && inode_create (inode_sector, initial_size, false)
+                  && dir_add (dir, name, inode_sector, false));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
+  free_map_flush ();
 
   return success;
 }
 
-/* Opens the file with the given NAME.
+/* Creates a directory named by PATH.
+   Returns true if successful, false otherwise.
+   Fails if something named by PATH already exists, if a
+   directory in PATH does not exist, or if internal memory
+   allocation fails. */
+bool
+filesys_mkdir (const char *path)
+{
+  block_sector_t inode_sector = 0;
+  char name[NAME_MAX + 1];
+  struct dir *dir = NULL;
+  bool success = (resolve_parent (path, &dir, name)
+                  && free_map_allocate (1, &inode_sector)
+                  && dir_create (inode_sector,
+                                 inode_get_inumber (dir_get_inode (dir)), 0));
+  if (success && !dir_add (dir, name, inode_sector, true))
+    {
+      /* Undo dir_create(), freeing the directory's sectors. */
+      struct inode *inode = inode_open (inode_sector);
+      inode_remove (inode);
+      inode_close (inode);
+      success = false;
+    }
+  dir_close (dir);
+  free_map_flush ();
+
+  return success;
+}
+
+/* Opens the inode named by PATH, which may be a file or a
+   directory.  Returns the new inode if successful or a null
+   pointer otherwise. */
+static struct inode *
+open_inode (const char *path)
+{
+  char name[NAME_MAX + 1];
+  struct dir *dir;
+  struct inode *inode = NULL;
+
+  if (resolve_parent (path, &dir, name))
+    {
+      dir_lookup (dir, name, &inode);
+      dir_close (dir);
+    }
+  return inode;
+}
+
+/* Opens the file or directory named by PATH.
    Returns the new file if successful or a null pointer
-   otherwise.
-   Fails if no file named NAME exists,
+   otherwise.  For a directory, use file_get_inode() and
+   dir_open() to read its entries.
+   Fails if nothing named PATH exists,
    or if an internal memory allocation fails. */
 struct file *
-filesys_open (const char *name)
+filesys_open (const char *path)
 {
-  struct dir *dir = dir_open_root ();
-  struct inode *inode = NULL;
+  return file_open (open_inode (path));
+}
 
-  if (dir != NULL)
-    dir_lookup (dir, name, &inode);
-  dir_close (dir);
+/* Fills in *ST with information about the file or directory
+   named by PATH, without opening a file for it.  The open count
+   does not include the reference held while doing so.  Like
+   inode_stat(), ST must not be in user memory.
+   Returns true if successful, false if nothing named PATH
+   exists. */
+bool
+filesys_stat (const char *path, struct stat *st)
+{
+  struct inode *inode = open_inode (path);
 
-  return file_open (inode);
+  if (inode == NULL)
+    return false;
+  inode_stat (inode, st);
+  st->st_opencnt--;
+  inode_close (inode);
+  return true;
 }
 
-/* Deletes the file named NAME.
+/* Opens the directory named by PATH.
+   Returns the new directory if successful or a null pointer
+   otherwise. */
+struct dir *
+filesys_open_dir (const char *path)
+{
+  return dir_open (open_inode (path));
+}
+
+/* Changes the current thread's working directory to PATH.
+   Returns true if successful, false on failure. */
+bool
+filesys_chdir (const char *path)
+{
+  struct thread *cur = thread_current ();
+  struct dir *dir = filesys_open_dir (path);
+
+  if (dir == NULL)
+    return false;
+  dir_close (cur->cwd);
+  cur->cwd = dir;
+  return true;
+}
+
+/* Deletes the file or empty directory named by PATH.
    Returns true if successful, false on failure.
-   Fails if no file named NAME exists,
-   or if an internal memory allocation fails. */
+   Fails if nothing named PATH exists, if PATH names a directory
+   that is not empty or still open, or if an internal memory
+   allocation fails. */
 bool
-filesys_remove (const char *name) 
+filesys_remove (const char *path) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char name[NAME_MAX + 1];
+  struct dir *dir = NULL;
+  bool success = (resolve_parent (path, &dir, name)
+                  && dir_remove (dir, name));
   dir_close (dir); 
+  free_map_flush ();
 
   return success;
 }
-
+
 /* Formats the file system. */
 static void
 do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
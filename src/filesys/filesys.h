@@ -11,10 +11,17 @@
 /* Block device that contains the file system. */
 struct block *fs_device;
 
+struct dir;
+struct stat;
+
 void filesys_init (bool format);
 void filesys_done (void);
-bool filesys_create (const char *name, off_t initial_size);
-struct file *filesys_open (const char *name);
-bool filesys_remove (const char *name);
+bool filesys_create (const char *path, off_t initial_size);
+bool filesys_mkdir (const char *path);
+struct file *filesys_open (const char *path);
+struct dir *filesys_open_dir (const char *path);
+bool filesys_stat (const char *path, struct stat *);
+bool filesys_chdir (const char *path);
+bool filesys_remove (const char *path);
 
 #endif /* filesys/filesys.h */
@@ -1,12 +1,27 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
+#include <stdio.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct bitmap *dirty_map;     /* One bit per free map file sector. */
+
+/* Protects free_map and dirty_map.  May be acquired while
+   holding an inode's lock, so it must never be held while
+   waiting for any inode other than the free map's own. */
+static struct lock free_map_lock;
+
+/* Number of free map bits stored in one sector of the free map
+   file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
+
+static void mark_dirty (block_sector_t, size_t);
 
 /* Initializes the free map. */
 void
@@ -15,38 +30,86 @@ free_map_init (void)
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  lock_init (&free_map_lock);
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+
+  dirty_map = bitmap_create (DIV_ROUND_UP (bitmap_size (free_map),
+                                           BITS_PER_SECTOR));
+  if (dirty_map == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available.
+   The change only reaches disk at the next free_map_flush(). */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  if (sector != BITMAP_ERROR)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      mark_dirty (sector, cnt);
+      *sectorp = sector;
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+  lock_release (&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Makes CNT sectors starting at SECTOR available for use.
+   The change only reaches disk at the next free_map_flush(). */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Records that the free map file sectors holding the bits for
+   CNT sectors starting at SECTOR need to be written back. */
+static void
+mark_dirty (block_sector_t sector, size_t cnt)
+{
+  size_t first, last;
+
+  if (cnt == 0)
+    return;
+  first = sector / BITS_PER_SECTOR;
+  last = (sector + cnt - 1) / BITS_PER_SECTOR;
+  bitmap_set_multiple (dirty_map, first, last - first + 1, true);
+}
+
+/* Writes the free map sectors changed since the last flush back
+   to the free map file.  Returns true if successful, false if
+   any write failed, in which case the failed sectors stay
+   dirty. */
+bool
+free_map_flush (void)
+{
+  size_t idx = 0;
+  bool success = true;
+
+  lock_acquire (&free_map_lock);
+  if (free_map_file != NULL)
+    while ((idx = bitmap_scan (dirty_map, idx, 1, true)) != BITMAP_ERROR)
+      {
+        if (bitmap_write_bytes (free_map, free_map_file,
+                                idx * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE))
+          bitmap_reset (dirty_map, idx);
+        else
+          success = false;
+        idx++;
+      }
+  lock_release (&free_map_lock);
+  return success;
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -58,13 +121,17 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  bitmap_set_all (dirty_map, false);
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) 
 {
+  if (!free_map_flush ())
+    printf ("free map: write-back failed\n");
   file_close (free_map_file);
+  free_map_file = NULL;
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -73,7 +140,7 @@ void
 free_map_create (void) 
 {
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
@@ -82,4 +149,5 @@ free_map_create (void)
     PANIC ("can't open free map");
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
+  bitmap_set_all (dirty_map, false);
 }
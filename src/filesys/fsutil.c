@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,6 +10,7 @@
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* List files in the root directory. */
@@ -67,6 +69,25 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Completion function for fsutil_extract()'s read requests. */
+static void
+read_done (struct block_request *r)
+{
+  sema_up (r->aux);
+}
+
+/* Uses R to start reading SIZE bytes, at most a page, starting at
+   SECTOR of SRC into BUFFER. */
+static void
+start_read (struct block *src, struct block_request *r,
+            block_sector_t sector, int size, void *buffer)
+{
+  r->sector = sector;
+  r->cnt = DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
+  r->buffer = buffer;
+  block_submit (src, r);
+}
+
 /* Extracts a ustar-format tar archive from the scratch block
    device into the Pintos file system. */
 void
@@ -75,13 +96,21 @@ fsutil_extract (char **argv UNUSED)
   static block_sector_t sector = 0;
 
   struct block *src;
-  void *header, *data;
+  struct block_request r;
+  struct semaphore read_sema;
+  void *header, *data[2];
 
-  /* Allocate buffers. */
+  /* Allocate buffers.  File data is read a page at a time, into
+     one page while the other is being written out. */
   header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
-  if (header == NULL || data == NULL)
+  data[0] = palloc_get_page (0);
+  data[1] = palloc_get_page (0);
+  if (header == NULL || data[0] == NULL || data[1] == NULL)
     PANIC ("couldn't allocate buffers");
+  sema_init (&read_sema, 0);
+  r.write = false;
+  r.complete = read_done;
+  r.aux = &read_sema;
 
   /* Open source block device. */
   src = block_get_role (BLOCK_SCRATCH);
@@ -114,6 +143,7 @@ fsutil_extract (char **argv UNUSED)
       else if (type == USTAR_REGULAR)
         {
           struct file *dst;
+          int i;
 
           printf ("Putting '%s' into the file system...\n", file_name);
 
@@ -124,14 +154,29 @@ fsutil_extract (char **argv UNUSED)
           if (dst == NULL)
             PANIC ("%s: open failed", file_name);
 
-          /* Do copy. */
-          while (size > 0)
+          /* Reserve its sectors in one go, so that they end up
+             contiguous instead of being allocated one write at a
+             time. */
+          if (!file_allocate (dst, 0, size))
+            PANIC ("%s: allocate failed", file_name);
+
+          /* Do copy, reading each page from the scratch device
+             while the one before it is written to the file
+             system. */
+          if (size > 0)
+            start_read (src, &r, sector, size > PGSIZE ? PGSIZE : size,
+                        data[0]);
+          for (i = 0; size > 0; i = !i)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
-                                : size);
-              block_read (src, sector++, data);
-              if (file_write (dst, data, chunk_size) != chunk_size)
+              int chunk_size = size > PGSIZE ? PGSIZE : size;
+              int rest = size - chunk_size;
+
+              sema_down (&read_sema);
+              sector += r.cnt;
+              if (rest > 0)
+                start_read (src, &r, sector, rest > PGSIZE ? PGSIZE : rest,
+                            data[!i]);
+              if (file_write (dst, data[i], chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
               size -= chunk_size;
@@ -151,7 +196,8 @@ fsutil_extract (char **argv UNUSED)
   block_write (src, 0, header);
   block_write (src, 1, header);
 
-  free (data);
+  palloc_free_page (data[1]);
+  palloc_free_page (data[0]);
   free (header);
 }
 
@@ -1,23 +1,78 @@
 #include "filesys/inode.h"
+#include <hash.h>
+#include <iovec.h>
 #include <list.h>
 #include <debug.h>
+#include <limits.h>
 #include <round.h>
+#include <stat.h>
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Number of data sectors addressed directly by an inode. */
+#define DIRECT_CNT 121
+
+/* Number of sector numbers in an indirect index sector. */
+#define PTRS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* Maximum number of data sectors in a file: direct, then through
+   the indirect sector, then through the doubly indirect sector. */
+#define MAX_SECTORS (DIRECT_CNT + PTRS_PER_SECTOR \
+                     + PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+
+/* Number of bytes of file data that fit in the inode sector
+   itself, in place of the sector index. */
+#define INLINE_MAX ((DIRECT_CNT + 2) * sizeof (block_sector_t))
+
+/* Inode flags. */
+#define INODE_DIR 0x1                   /* Directory, not a file. */
+#define INODE_INLINE 0x2                /* Data is in inline_data. */
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   A file created no longer than INLINE_MAX bytes keeps its data
+   in the inode sector, so reading it takes a single sector read
+   and it uses no data sectors.  It moves to the sector index the
+   first time it grows past INLINE_MAX.
+
+   A sector number of 0 in the index means "not allocated".
+   Sector 0 holds the free map inode, so it can never be a data
+   or index sector.  Files may be sparse: an unallocated data
+   sector within the file's length is a hole that reads as
+   zeros, and gets a sector only when it is first written.
+
+   Bytes at or past VALID_LENGTH also read as zeros, whether or
+   not their sectors are allocated.  This lets inode_allocate()
+   reserve sectors past the data written so far without zeroing
+   them first.  A write that starts past VALID_LENGTH zeros the
+   gap before moving it. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
+    off_t valid_length;                 /* Bytes written, at most LENGTH. */
+    uint32_t sector_cnt;                /* Data and index sectors in use. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t flags;                     /* INODE_* flags. */
+    union
+      {
+        struct
+          {
+            block_sector_t direct[DIRECT_CNT];  /* Data sectors. */
+            block_sector_t indirect;    /* Index of further data sectors. */
+            block_sector_t doubly_indirect; /* Index of indirect sectors. */
+          };
+        uint8_t inline_data[INLINE_MAX];    /* Data, if INODE_INLINE. */
+      };
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -28,51 +83,401 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* Maximum number of inodes with no openers that are kept in
+   memory, so that reopening a recently used file does not have
+   to read its inode from disk again.  0 disables the cache. */
+#define INODE_CACHE_CNT 64
+
+/* Maximum pages in the buffer through which file data is copied
+   to and from user memory.  An inode's rwlock is never held while user
+   memory is touched, because the page fault that touching it may
+   cause can itself need to read a file: even the file being
+   written, if the buffer is a page of it mapped with mmap(). */
+#define STAGE_PAGES 8
+
+/* In-memory inode.
+
+   Members marked with [T] are protected by inode_table_lock,
+   those marked [I] by the inode's own RWLOCK, and those marked
+   [L] by its LOCK, which higher layers take through
+   inode_lock(). */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem hash_elem;         /* [T] Element in inode_table. */
+    struct list_elem lru_elem;          /* [T] Element in unused_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
-    int open_cnt;                       /* Number of openers. */
-    bool removed;                       /* True if deleted, false otherwise. */
-    int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
-    struct inode_disk data;             /* Inode content. */
+    int open_cnt;                       /* [T] Number of openers. */
+    bool removed;                       /* [T] True if deleted. */
+    bool loading;                       /* [T] DATA not yet read from disk? */
+    struct rwlock rwlock;               /* Guards data and file contents. */
+    int deny_write_cnt;                 /* [I] 0: writes ok, >0: deny writes. */
+    struct lock lock;                   /* For use by higher layers. */
+    void *aux;                          /* [L] Data owned by a higher layer. */
+    void (*destroy_aux) (void *);       /* [L] Frees AUX, if non-null. */
+    struct inode_disk data;             /* [I] Inode content. */
   };
 
+/* A sector's worth of zeros. */
+static char zeros[BLOCK_SECTOR_SIZE];
+
+/* Allocates a sector for the file described by DISK_INODE and
+   stores its number in *SLOT, unless *SLOT already names a
+   sector.  If RESERVED is nonzero, it is a sector that the
+   caller already took from the free map, which is used instead
+   of allocating a new one.  The new sector is zeroed on disk if
+   ZERO is true; otherwise its contents are undefined.
+   Returns true if successful, false if the disk is full. */
+static bool
+allocate_sector (struct inode_disk *disk_inode, block_sector_t *slot,
+                 bool zero, block_sector_t reserved)
+{
+  if (*slot != 0)
+    return true;
+  if (reserved != 0)
+    *slot = reserved;
+  else if (!free_map_allocate (1, slot))
+    return false;
+  if (zero)
+    block_write (fs_device, *slot, zeros);
+  disk_inode->sector_cnt++;
+  return true;
+}
+
+/* Returns entry IDX of the index stored in sector INDEX_SECTOR,
+   which belongs to the file described by DISK_INODE.
+   If the entry is 0 and ALLOCATE is true, first allocates a
+   sector for it as allocate_sector() does with ZERO and
+   RESERVED, and updates the index on disk.
+   Returns 0 if the entry is unallocated or allocation fails. */
+static block_sector_t
+index_entry (struct inode_disk *disk_inode, block_sector_t index_sector,
+             size_t idx, bool allocate, bool zero, block_sector_t reserved)
+{
+  block_sector_t *index;
+  block_sector_t sector;
+
+  ASSERT (idx < PTRS_PER_SECTOR);
+
+  index = malloc (BLOCK_SECTOR_SIZE);
+  if (index == NULL)
+    return 0;
+  block_read (fs_device, index_sector, index);
+  sector = index[idx];
+  if (sector == 0 && allocate
+      && allocate_sector (disk_inode, &index[idx], zero, reserved))
+    {
+      sector = index[idx];
+      block_write (fs_device, index_sector, index);
+    }
+  free (index);
+  return sector;
+}
+
+/* Returns the disk sector that holds data sector SECTOR_IDX of
+   the file described by DISK_INODE.
+   If that sector is not allocated and ALLOCATE is true, first
+   allocates it, zeroed if ZERO is true, plus any (always zeroed)
+   index sectors needed to reach it.  The data sector is RESERVED
+   if that is nonzero; see allocate_sector().  A newly allocated
+   direct, indirect or doubly indirect pointer is stored in
+   DISK_INODE, which the caller must write back.
+   Returns 0 if the sector is not allocated or allocation
+   fails. */
+static block_sector_t
+index_lookup (struct inode_disk *disk_inode, size_t sector_idx,
+              bool allocate, bool zero, block_sector_t reserved)
+{
+  block_sector_t indirect;
+
+  if (sector_idx < DIRECT_CNT)
+    {
+      block_sector_t *slot = &disk_inode->direct[sector_idx];
+      if (*slot == 0 && allocate)
+        allocate_sector (disk_inode, slot, zero, reserved);
+      return *slot;
+    }
+  sector_idx -= DIRECT_CNT;
+
+  if (sector_idx < PTRS_PER_SECTOR)
+    {
+      if ((disk_inode->indirect == 0 && !allocate)
+          || !allocate_sector (disk_inode, &disk_inode->indirect, true, 0))
+        return 0;
+      return index_entry (disk_inode, disk_inode->indirect, sector_idx,
+                          allocate, zero, reserved);
+    }
+  sector_idx -= PTRS_PER_SECTOR;
+
+  if (sector_idx < PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+    {
+      if ((disk_inode->doubly_indirect == 0 && !allocate)
+          || !allocate_sector (disk_inode, &disk_inode->doubly_indirect,
+                               true, 0))
+        return 0;
+      indirect = index_entry (disk_inode, disk_inode->doubly_indirect,
+                              sector_idx / PTRS_PER_SECTOR, allocate, true, 0);
+      if (indirect == 0)
+        return 0;
+      return index_entry (disk_inode, indirect, sector_idx % PTRS_PER_SECTOR,
+                          allocate, zero, reserved);
+    }
+
+  return 0;
+}
+
+/* Releases every allocated sector listed in index sector
+   INDEX_SECTOR, descending LEVELS further levels of indirection,
+   and then INDEX_SECTOR itself. */
+static void
+release_index (block_sector_t index_sector, int levels)
+{
+  block_sector_t *index;
+  size_t i;
+
+  if (index_sector == 0)
+    return;
+
+  index = malloc (BLOCK_SECTOR_SIZE);
+  if (index != NULL)
+    {
+      block_read (fs_device, index_sector, index);
+      for (i = 0; i < PTRS_PER_SECTOR; i++)
+        if (index[i] != 0)
+          {
+            if (levels > 0)
+              release_index (index[i], levels - 1);
+            else
+              free_map_release (index[i], 1);
+          }
+      free (index);
+    }
+  free_map_release (index_sector, 1);
+}
+
+/* Releases all of the data and index sectors of DISK_INODE. */
+static void
+release_sectors (struct inode_disk *disk_inode)
+{
+  size_t i;
+
+  if (disk_inode->flags & INODE_INLINE)
+    return;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    if (disk_inode->direct[i] != 0)
+      free_map_release (disk_inode->direct[i], 1);
+  release_index (disk_inode->indirect, 0);
+  release_index (disk_inode->doubly_indirect, 1);
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   POS, either because POS is past the end of the file or because
+   it falls in a hole. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos) 
 {
   ASSERT (inode != NULL);
   if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-  else
-    return -1;
+    {
+      block_sector_t sector = index_lookup (&inode->data,
+                                            pos / BLOCK_SECTOR_SIZE,
+                                            false, false, 0);
+      if (sector != 0)
+        return sector;
+    }
+  return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+static bool inode_uninline (struct inode *);
+static bool zero_gap (struct inode *, off_t from, off_t to);
+static off_t readv_staged (struct inode *, const struct iovec *, int cnt,
+                           off_t size, off_t offset, uint8_t **bounce);
+static off_t writev_locked (struct inode *, const struct iovec *, int cnt,
+                            off_t size, off_t offset, uint8_t **bounce);
+static off_t writev_staged (struct inode *, const struct iovec *, int cnt,
+                            off_t size, off_t offset, uint8_t **bounce);
+
+/* Prepares INODE for a write of SIZE bytes at OFFSET, where SIZE
+   is positive, by allocating every data sector in that range
+   that is still a hole, then extending INODE's length and valid
+   length to cover the write, and writing the updated inode to
+   disk if it changed.  An inline inode that the write still fits in only
+   has its length updated in memory; one that it does not fit in
+   is first moved to the sector index.
+
+   A new sector that the write covers completely is not zeroed,
+   since it is about to be overwritten.  One that it covers only
+   in part is zeroed, so that the rest of it reads as zeros.  If
+   the write starts past the valid length, the allocated sectors
+   in between are zeroed too.
+
+   If the disk fills up, prepares as much of the range as
+   possible.  Returns the number of bytes, starting at OFFSET,
+   that may now be written. */
+static off_t
+inode_prepare_write (struct inode *inode, off_t offset, off_t size)
+{
+  off_t end = offset + size;
+  size_t first = offset / BLOCK_SECTOR_SIZE;
+  size_t last = bytes_to_sectors (end);
+  bool dirty = false;
+  size_t i;
+
+  if (offset < 0 || end < offset)
+    return 0;
+
+  if (inode->data.flags & INODE_INLINE)
+    {
+      if (end <= (off_t) INLINE_MAX)
+        {
+          if (end > inode->data.length)
+            inode->data.length = end;
+          return size;
+        }
+      if (!inode_uninline (inode))
+        return 0;
+    }
+
+  if (last > MAX_SECTORS)
+    {
+      last = MAX_SECTORS;
+      end = MAX_SECTORS * BLOCK_SECTOR_SIZE;
+    }
+
+  for (i = first; i < last; i++)
+    if (index_lookup (&inode->data, i, false, false, 0) == 0)
+      {
+        off_t start = i * BLOCK_SECTOR_SIZE;
+        bool partial = start < offset || start + BLOCK_SECTOR_SIZE > end;
+        if (index_lookup (&inode->data, i, true, partial, 0) == 0)
+          {
+            end = start;
+            break;
+          }
+        dirty = true;
+      }
+
+  if (end > offset && offset > inode->data.valid_length
+      && !zero_gap (inode, inode->data.valid_length, offset))
+    end = offset;
+  if (end > offset && end > inode->data.valid_length)
+    {
+      inode->data.valid_length = end;
+      dirty = true;
+    }
+  if (end > inode->data.length)
+    {
+      inode->data.length = end;
+      dirty = true;
+    }
+  if (dirty)
+    block_write (fs_device, inode->sector, &inode->data);
+  return end > offset ? end - offset : 0;
+}
+
+/* In-memory inodes, keyed by sector, so that opening a single
+   inode twice returns the same `struct inode'.  Holds both open
+   inodes and the cached ones in unused_inodes. */
+static struct hash inode_table;
+
+/* Protects inode_table, unused_inodes, unused_cnt, and the
+   members of each inode marked [T].  Never held across disk I/O. */
+static struct lock inode_table_lock;
+
+/* Signaled, with inode_table_lock, when an inode that
+   inode_open() is reading from disk has finished loading. */
+static struct condition inode_loaded;
+
+/* Inodes in inode_table with no openers, most recently closed
+   first. */
+static struct list unused_inodes;
+static size_t unused_cnt;
+
+static unsigned inode_hash (const struct hash_elem *, void *);
+static bool inode_less (const struct hash_elem *, const struct hash_elem *,
+                        void *);
+static struct inode *inode_lookup (block_sector_t);
+static void inode_evict (struct inode *);
+static void inode_free (struct inode *);
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  hash_init (&inode_table, inode_hash, inode_less, NULL);
+  lock_init (&inode_table_lock);
+  cond_init (&inode_loaded);
+  list_init (&unused_inodes);
+  unused_cnt = 0;
+}
+
+/* Returns a hash value for the inode containing E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct inode *inode = hash_entry (e, struct inode, hash_elem);
+  return hash_int (inode->sector);
+}
+
+/* Returns true if inode A's sector precedes inode B's. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, hash_elem)->sector
+          < hash_entry (b, struct inode, hash_elem)->sector);
+}
+
+/* Returns the in-memory inode for SECTOR, open or cached, or a
+   null pointer if there is none.
+   The caller must hold inode_table_lock. */
+static struct inode *
+inode_lookup (block_sector_t sector)
+{
+  struct inode key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&inode_table, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct inode, hash_elem) : NULL;
+}
+
+/* Drops unused INODE from the cache and frees it.
+   The caller must hold inode_table_lock. */
+static void
+inode_evict (struct inode *inode)
+{
+  ASSERT (lock_held_by_current_thread (&inode_table_lock));
+  ASSERT (inode->open_cnt == 0);
+  list_remove (&inode->lru_elem);
+  unused_cnt--;
+  hash_delete (&inode_table, &inode->hash_elem);
+  inode_free (inode);
+}
+
+/* Frees INODE's memory, including any data attached to it with
+   inode_set_aux(). */
+static void
+inode_free (struct inode *inode)
+{
+  if (inode->destroy_aux != NULL)
+    inode->destroy_aux (inode->aux);
+  free (inode);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The inode is a directory if IS_DIR is true.  Its data
+   is stored inline if LENGTH is at most INLINE_MAX.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
+  struct inode *stale;
   bool success = false;
 
   ASSERT (length >= 0);
@@ -81,25 +486,29 @@ inode_create (block_sector_t sector, off_t length)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
+  /* A stale cached copy of whatever used to live in SECTOR must
+     not be handed out for the new inode. */
+  lock_acquire (&inode_table_lock);
+  stale = inode_lookup (sector);
+  if (stale != NULL)
+    {
+      ASSERT (stale->open_cnt == 0);
+      inode_evict (stale);
+    }
+  lock_release (&inode_table_lock);
+
+  /* No data sectors are allocated here: the whole file starts out
+     as a hole, so creating a file of any size takes one write. */
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+      disk_inode->flags = ((is_dir ? INODE_DIR : 0)
+                           | (length <= (off_t) INLINE_MAX ? INODE_INLINE : 0));
+      success = bytes_to_sectors (length) <= MAX_SECTORS;
+      if (success)
+        block_write (fs_device, sector, disk_inode);
       free (disk_inode);
     }
   return success;
@@ -111,33 +520,56 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
   struct inode *inode;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  lock_acquire (&inode_table_lock);
+
+  /* Check whether this inode is already open or cached.  If
+     another thread is still reading it in, wait for that. */
+  inode = inode_lookup (sector);
+  if (inode != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
+      if (inode->open_cnt == 0)
         {
-          inode_reopen (inode);
-          return inode; 
+          list_remove (&inode->lru_elem);
+          unused_cnt--;
         }
+      inode->open_cnt++;
+      while (inode->loading)
+        cond_wait (&inode_loaded, &inode_table_lock);
+      lock_release (&inode_table_lock);
+      return inode;
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&inode_table_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize, and insert the inode marked as loading, so that
+     other openers of it wait while it is read without holding
+     inode_table_lock. */
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
+  inode->loading = true;
+  rwlock_init (&inode->rwlock);
+  lock_init (&inode->lock);
+  inode->aux = NULL;
+  inode->destroy_aux = NULL;
+  hash_insert (&inode_table, &inode->hash_elem);
+  lock_release (&inode_table_lock);
+
   block_read (fs_device, inode->sector, &inode->data);
+
+  lock_acquire (&inode_table_lock);
+  inode->loading = false;
+  cond_broadcast (&inode_loaded, &inode_table_lock);
+  lock_release (&inode_table_lock);
   return inode;
 }
 
@@ -146,7 +578,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&inode_table_lock);
+      inode->open_cnt++;
+      lock_release (&inode_table_lock);
+    }
   return inode;
 }
 
@@ -158,8 +594,11 @@ inode_get_inumber (const struct inode *inode)
 }
 
 /* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If this was the last reference to INODE, moves it to the cache
+   of unused inodes, evicting the least recently used one if the
+   cache is full.
+   If INODE was also a removed inode, frees its blocks and its
+   memory instead. */
 void
 inode_close (struct inode *inode) 
 {
@@ -167,22 +606,32 @@ inode_close (struct inode *inode)
   if (inode == NULL)
     return;
 
+  lock_acquire (&inode_table_lock);
+
   /* Release resources if this was the last opener. */
   if (--inode->open_cnt == 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
+      /* Deallocate blocks and memory if removed.  Nobody else
+         can reach INODE once it is out of inode_table, so its
+         sectors are released without holding the table lock. */
       if (inode->removed) 
         {
+          hash_delete (&inode_table, &inode->hash_elem);
+          lock_release (&inode_table_lock);
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          release_sectors (&inode->data);
+          inode_free (inode);
+          return;
         }
 
-      free (inode); 
+      /* Otherwise keep it around for a later inode_open(). */
+      list_push_front (&unused_inodes, &inode->lru_elem);
+      unused_cnt++;
+      if (unused_cnt > INODE_CACHE_CNT)
+        inode_evict (list_entry (list_back (&unused_inodes),
+                                 struct inode, lru_elem));
     }
+  lock_release (&inode_table_lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -191,18 +640,370 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&inode_table_lock);
   inode->removed = true;
+  lock_release (&inode_table_lock);
 }
 
-/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+/* Takes the calling thread's sector-sized bounce buffer for
+   partial-sector transfers, allocating it on first use.  The
+   buffer is handed back with put_bounce() and kept until the
+   thread exits, so file I/O does not call malloc() each time.
+   A nested call, e.g. from a page fault taken while copying out
+   of the buffer, gets a fresh one instead of clobbering it.
+   Returns a null pointer if memory is short. */
+static uint8_t *
+get_bounce (void)
+{
+  struct thread *t = thread_current ();
+  uint8_t *bounce = t->bounce;
+
+  t->bounce = NULL;
+  return bounce != NULL ? bounce : malloc (BLOCK_SECTOR_SIZE);
+}
+
+/* Gives BOUNCE, obtained from get_bounce(), back to the calling
+   thread for reuse. */
+static void
+put_bounce (uint8_t *bounce)
+{
+  struct thread *t = thread_current ();
+
+  if (t->bounce == NULL)
+    t->bounce = bounce;
+  else
+    free (bounce);
+}
+
+/* Takes a buffer through which a transfer of LENGTH bytes is
+   staged on its way to or from user memory, and stores its size
+   in *SIZE.  A transfer of a sector or less is staged through
+   the buffer from get_bounce(); a longer one through enough
+   pages to hold it, up to STAGE_PAGES, or one page if that many
+   are not available.  The buffer is recorded in the calling
+   thread until put_stage() frees it, so that thread_exit() can
+   free it if the process is killed by a fault on user memory
+   while copying through it.
+   Returns a null pointer if memory is short. */
+static uint8_t *
+get_stage (off_t length, size_t *size)
+{
+  struct thread *t = thread_current ();
+  size_t page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  uint8_t *stage = NULL;
+
+  ASSERT (t->stage == NULL);
+
+  if (length > BLOCK_SECTOR_SIZE)
+    {
+      if (page_cnt > STAGE_PAGES)
+        page_cnt = STAGE_PAGES;
+      stage = palloc_get_multiple (0, page_cnt);
+      if (stage == NULL && page_cnt > 1)
+        {
+          page_cnt = 1;
+          stage = palloc_get_page (0);
+        }
+    }
+  if (stage != NULL)
+    *size = page_cnt * PGSIZE;
+  else
+    {
+      page_cnt = 0;
+      stage = get_bounce ();
+      *size = BLOCK_SECTOR_SIZE;
+    }
+  t->stage = stage;
+  t->stage_pages = page_cnt;
+  return stage;
+}
+
+/* Frees STAGE, obtained from get_stage(). */
+static void
+put_stage (uint8_t *stage)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (stage == t->stage);
+  if (t->stage_pages == 0)
+    put_bounce (stage);
+  else
+    palloc_free_multiple (stage, t->stage_pages);
+  t->stage = NULL;
+}
+
+/* Returns the total length of the CNT buffers described by IOV,
+   or -1 if it does not fit in an off_t. */
+static off_t
+iov_length (const struct iovec *iov, int cnt)
+{
+  off_t size = 0;
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      if (iov[i].iov_len > (size_t) (INT_MAX - size))
+        return -1;
+      size += iov[i].iov_len;
+    }
+  return size;
+}
+
+/* Returns true if any of the CNT buffers described by IOV is in
+   user memory. */
+static bool
+iov_in_user (const struct iovec *iov, int cnt)
+{
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    if (iov[i].iov_len > 0 && is_user_vaddr (iov[i].iov_base))
+      return true;
+  return false;
+}
+
+/* Copies SIZE bytes between STAGE and the CNT buffers described by
+   IOV, starting *OFS bytes into IOV[*I], and advances *I and *OFS
+   past them.  Copies into the buffers if TO_IOV is true, out of
+   them otherwise. */
+static void
+copy_iov (const struct iovec *iov, int cnt, int *i, size_t *ofs,
+          uint8_t *stage, size_t size, bool to_iov)
+{
+  while (size > 0)
+    {
+      size_t n = iov[*i].iov_len - *ofs;
+
+      ASSERT (*i < cnt);
+      if (n > size)
+        n = size;
+      if (to_iov)
+        memcpy ((uint8_t *) iov[*i].iov_base + *ofs, stage, n);
+      else
+        memcpy (stage, (const uint8_t *) iov[*i].iov_base + *ofs, n);
+      stage += n;
+      size -= n;
+      *ofs += n;
+      if (*ofs == iov[*i].iov_len)
+        {
+          (*i)++;
+          *ofs = 0;
+        }
+    }
+}
+
+/* Moves INODE's inline data into a newly allocated data sector
+   and switches INODE to the sector index, writing the updated
+   inode to disk.  Returns true if successful, false if memory or
+   disk space is short, in which case INODE is unchanged. */
+static bool
+inode_uninline (struct inode *inode)
+{
+  struct inode_disk *data = &inode->data;
+  uint8_t *bounce;
+  bool success = true;
+
+  ASSERT (data->flags & INODE_INLINE);
+
+  bounce = get_bounce ();
+  if (bounce == NULL)
+    return false;
+  memset (bounce, 0, BLOCK_SECTOR_SIZE);
+  memcpy (bounce, data->inline_data, INLINE_MAX);
+
+  memset (data->inline_data, 0, INLINE_MAX);
+  data->flags &= ~INODE_INLINE;
+  if (data->length > 0)
+    {
+      block_sector_t sector = index_lookup (data, 0, true, false, 0);
+      if (sector != 0)
+        block_write (fs_device, sector, bounce);
+      else
+        {
+          memcpy (data->inline_data, bounce, INLINE_MAX);
+          data->flags |= INODE_INLINE;
+          success = false;
+        }
+    }
+  if (success)
+    data->valid_length = data->length;
+  if (success)
+    block_write (fs_device, inode->sector, data);
+
+  put_bounce (bounce);
+  return success;
+}
+
+/* Zeros the bytes of INODE from FROM up to TO that lie in
+   allocated sectors, so that moving INODE's valid length from
+   FROM to TO cannot expose whatever those sectors held before.
+   Only the sector holding FROM can contain valid data, so it is
+   the only one that has to be read first.
+   Returns false if memory is short. */
+static bool
+zero_gap (struct inode *inode, off_t from, off_t to)
+{
+  while (from < to)
+    {
+      block_sector_t sector = index_lookup (&inode->data,
+                                            from / BLOCK_SECTOR_SIZE,
+                                            false, false, 0);
+      int sector_ofs = from % BLOCK_SECTOR_SIZE;
+
+      if (sector != 0 && sector_ofs == 0)
+        block_write (fs_device, sector, zeros);
+      else if (sector != 0)
+        {
+          uint8_t *bounce = get_bounce ();
+          if (bounce == NULL)
+            return false;
+          block_read (fs_device, sector, bounce);
+          memset (bounce + sector_ofs, 0, BLOCK_SECTOR_SIZE - sector_ofs);
+          block_write (fs_device, sector, bounce);
+          put_bounce (bounce);
+        }
+      from += BLOCK_SECTOR_SIZE - sector_ofs;
+    }
+  return true;
+}
+
+/* Makes *INDEX, a buffer allocated on first use, hold the index
+   stored in INDEX_SECTOR, reading it only if *LOADED, the sector
+   it last held, differs.  Returns false if memory is short. */
+static bool
+load_index (block_sector_t **index, block_sector_t *loaded,
+            block_sector_t index_sector)
+{
+  if (*index == NULL)
+    {
+      *index = malloc (BLOCK_SECTOR_SIZE);
+      if (*index == NULL)
+        return false;
+    }
+  else if (*loaded == index_sector)
+    return true;
+  block_read (fs_device, index_sector, *index);
+  *loaded = index_sector;
+  return true;
+}
+
+/* Returns the number of whole sectors, at most CNT and at most
+   BLOCK_MULTIPLE_MAX, that begin at byte OFFSET in INODE and lie
+   in consecutive disk sectors starting at SECTOR, which holds the
+   byte at OFFSET.  Each index sector that the run passes through
+   is read only once. */
+static size_t
+contiguous_run (struct inode *inode, off_t offset, block_sector_t sector,
+                size_t cnt)
+{
+  struct inode_disk *data = &inode->data;
+  size_t first = offset / BLOCK_SECTOR_SIZE;
+  block_sector_t *index = NULL, *dindex = NULL;
+  block_sector_t index_loaded = 0, dindex_loaded = 0;
+  size_t run;
+
+  if (cnt > BLOCK_MULTIPLE_MAX)
+    cnt = BLOCK_MULTIPLE_MAX;
+
+  for (run = 1; run < cnt; run++)
+    {
+      size_t i = first + run;
+      block_sector_t next;
+
+      if (i < DIRECT_CNT)
+        next = data->direct[i];
+      else
+        {
+          block_sector_t index_sector;
+
+          i -= DIRECT_CNT;
+          if (i < PTRS_PER_SECTOR)
+            index_sector = data->indirect;
+          else
+            {
+              i -= PTRS_PER_SECTOR;
+              if (data->doubly_indirect == 0
+                  || !load_index (&dindex, &dindex_loaded,
+                                  data->doubly_indirect))
+                break;
+              index_sector = dindex[i / PTRS_PER_SECTOR];
+              i %= PTRS_PER_SECTOR;
+            }
+          if (index_sector == 0
+              || !load_index (&index, &index_loaded, index_sector))
+            break;
+          next = index[i];
+        }
+      if (next != sector + run)
+        break;
+    }
+
+  free (index);
+  free (dindex);
+  return run;
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR into
+   BUFFER, in as few device requests as possible. */
+static void
+read_run (block_sector_t sector, size_t cnt, void *buffer)
+{
+  uint8_t *p = buffer;
+
+  while (cnt > 0)
+    {
+      size_t chunk = cnt < BLOCK_MULTIPLE_MAX ? cnt : BLOCK_MULTIPLE_MAX;
+      block_read_multiple (fs_device, sector, chunk, p);
+      sector += chunk;
+      cnt -= chunk;
+      p += chunk * BLOCK_SECTOR_SIZE;
+    }
+}
+
+/* Writes BUFFER to the CNT consecutive sectors starting at
+   SECTOR, in as few device requests as possible. */
+static void
+write_run (block_sector_t sector, size_t cnt, const void *buffer)
+{
+  const uint8_t *p = buffer;
+
+  while (cnt > 0)
+    {
+      size_t chunk = cnt < BLOCK_MULTIPLE_MAX ? cnt : BLOCK_MULTIPLE_MAX;
+      block_write_multiple (fs_device, sector, chunk, p);
+      sector += chunk;
+      cnt -= chunk;
+      p += chunk * BLOCK_SECTOR_SIZE;
+    }
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position
+   OFFSET.  Partial sectors go through *BOUNCE, which is taken
+   with get_bounce() the first time it is needed if it is null.
+   The caller must hold INODE's rwlock.
    Returns the number of bytes actually read, which may be less
    than SIZE if an error occurs or end of file is reached. */
-off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+static off_t
+read_locked (struct inode *inode, uint8_t *buffer, off_t size, off_t offset,
+             uint8_t **bounce)
 {
-  uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+
+  if (offset < 0)
+    return 0;
+
+  if (inode->data.flags & INODE_INLINE)
+    {
+      /* Copy straight out of the inode. */
+      if (size > 0 && offset < inode->data.length)
+        {
+          bytes_read = inode->data.length - offset;
+          if (size < bytes_read)
+            bytes_read = size;
+          memcpy (buffer, inode->data.inline_data + offset, bytes_read);
+        }
+      return bytes_read;
+    }
 
   while (size > 0) 
     {
@@ -211,32 +1012,48 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      off_t inode_left = inode->data.length - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
+      /* Bytes left before the valid length. */
+      off_t valid_left = inode->data.valid_length - offset;
+
       /* Number of bytes to actually copy out of this sector. */
       int chunk_size = size < min_left ? size : min_left;
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      if (sector_idx == (block_sector_t) -1 || valid_left <= 0)
+        {
+          /* A hole, or data never written, reads as zeros. */
+          memset (buffer + bytes_read, 0, chunk_size);
+        }
+      else if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE
+               && valid_left >= BLOCK_SECTOR_SIZE)
         {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
+          /* Read full sectors directly into caller's buffer, as
+             many at a time as lie consecutively on disk. */
+          off_t whole = size < valid_left ? size : valid_left;
+          size_t cnt = contiguous_run (inode, offset, sector_idx,
+                                       whole / BLOCK_SECTOR_SIZE);
+          read_run (sector_idx, cnt, buffer + bytes_read);
+          chunk_size = cnt * BLOCK_SECTOR_SIZE;
         }
       else 
         {
           /* Read sector into bounce buffer, then partially copy
              into caller's buffer. */
-          if (bounce == NULL) 
+          if (chunk_size > valid_left)
+            chunk_size = valid_left;
+          if (*bounce == NULL) 
             {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
+              *bounce = get_bounce ();
+              if (*bounce == NULL)
                 break;
             }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          block_read (fs_device, sector_idx, *bounce);
+          memcpy (buffer + bytes_read, *bounce + sector_ofs, chunk_size);
         }
       
       /* Advance. */
@@ -244,27 +1061,126 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
 
   return bytes_read;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
-   Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+   Returns the number of bytes actually read, which may be less
+   than SIZE if an error occurs or end of file is reached. */
 off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
-                off_t offset) 
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) 
+{
+  struct iovec iov;
+
+  ASSERT (offset >= 0);
+
+  iov.iov_base = buffer;
+  iov.iov_len = size > 0 ? size : 0;
+  return inode_readv_at (inode, &iov, 1, offset);
+}
+
+/* Fills the CNT buffers described by IOV, in order, from
+   consecutive bytes of INODE starting at OFFSET.  If the buffers
+   are in kernel memory, INODE is locked once for the whole
+   transfer; user buffers are filled through a staging buffer,
+   one stage-full at a time.
+   Returns the total number of bytes actually read, which may be
+   less than requested if an error occurs or end of file is
+   reached. */
+off_t
+inode_readv_at (struct inode *inode, const struct iovec *iov, int cnt,
+                off_t offset)
 {
-  const uint8_t *buffer = buffer_;
-  off_t bytes_written = 0;
   uint8_t *bounce = NULL;
+  off_t size = iov_length (iov, cnt);
+  off_t bytes_read = 0;
+  int i;
 
-  if (inode->deny_write_cnt)
+  if (size <= 0 || offset < 0)
+    return 0;
+
+  if (iov_in_user (iov, cnt))
+    bytes_read = readv_staged (inode, iov, cnt, size, offset, &bounce);
+  else
+    {
+      rwlock_acquire_read (&inode->rwlock);
+      for (i = 0; i < cnt; i++)
+        {
+          off_t n = read_locked (inode, iov[i].iov_base, iov[i].iov_len,
+                                 offset + bytes_read, &bounce);
+          bytes_read += n;
+          if (n < (off_t) iov[i].iov_len)
+            break;
+        }
+      rwlock_release_read (&inode->rwlock);
+    }
+  if (bounce != NULL)
+    put_bounce (bounce);
+
+  return bytes_read;
+}
+
+/* Reads SIZE bytes of INODE starting at OFFSET into the CNT user
+   buffers described by IOV, through a staging buffer, so that
+   INODE's rwlock is released whenever user memory is touched.
+   Partial sectors go through *BOUNCE, as for read_locked().
+   Returns the number of bytes actually read. */
+static off_t
+readv_staged (struct inode *inode, const struct iovec *iov, int cnt,
+              off_t size, off_t offset, uint8_t **bounce)
+{
+  size_t stage_size;
+  uint8_t *stage = get_stage (size, &stage_size);
+  off_t bytes_read = 0;
+  size_t iov_ofs = 0;
+  int i = 0;
+
+  if (stage == NULL)
     return 0;
 
+  while (bytes_read < size)
+    {
+      off_t chunk = size - bytes_read;
+      off_t n;
+
+      if (chunk > (off_t) stage_size)
+        chunk = stage_size;
+      rwlock_acquire_read (&inode->rwlock);
+      n = read_locked (inode, stage, chunk, offset + bytes_read, bounce);
+      rwlock_release_read (&inode->rwlock);
+
+      copy_iov (iov, cnt, &i, &iov_ofs, stage, n, true);
+      bytes_read += n;
+      if (n < chunk)
+        break;
+    }
+
+  put_stage (stage);
+  return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   which inode_prepare_write() must already have readied.
+   Partial sectors go through *BOUNCE, as for read_locked().  An
+   inline inode is only updated in memory; the caller must write
+   it back.
+   The caller must hold INODE's rwlock for writing.
+   Returns the number of bytes actually written, which may be
+   less than SIZE if an error occurs. */
+static off_t
+write_locked (struct inode *inode, const uint8_t *buffer, off_t size,
+              off_t offset, uint8_t **bounce)
+{
+  off_t bytes_written = 0;
+
+  if (inode->data.flags & INODE_INLINE)
+    {
+      /* Update the inode in place. */
+      memcpy (inode->data.inline_data + offset, buffer, size);
+      return size;
+    }
+
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
@@ -272,7 +1188,7 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      off_t inode_left = inode->data.length - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -283,16 +1199,21 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
       if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
         {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
+          /* Write full sectors directly from caller's buffer, as
+             many at a time as lie consecutively on disk. */
+          off_t whole = size < inode_left ? size : inode_left;
+          size_t cnt = contiguous_run (inode, offset, sector_idx,
+                                       whole / BLOCK_SECTOR_SIZE);
+          write_run (sector_idx, cnt, buffer + bytes_written);
+          chunk_size = cnt * BLOCK_SECTOR_SIZE;
         }
       else 
         {
           /* We need a bounce buffer. */
-          if (bounce == NULL) 
+          if (*bounce == NULL) 
             {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
+              *bounce = get_bounce ();
+              if (*bounce == NULL)
                 break;
             }
 
@@ -300,11 +1221,11 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
              we're writing, then we need to read in the sector
              first.  Otherwise we start with a sector of all zeros. */
           if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
+            block_read (fs_device, sector_idx, *bounce);
           else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
+            memset (*bounce, 0, BLOCK_SECTOR_SIZE);
+          memcpy (*bounce + sector_ofs, buffer + bytes_written, chunk_size);
+          block_write (fs_device, sector_idx, *bounce);
         }
 
       /* Advance. */
@@ -312,18 +1233,243 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
 
   return bytes_written;
 }
 
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   Extends INODE if the write goes past its end, and allocates
+   sectors for any holes that it fills.
+   Returns the number of bytes actually written, which may be
+   less than SIZE if the disk fills up or an error occurs. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
+                off_t offset) 
+{
+  struct iovec iov;
+
+  ASSERT (offset >= 0);
+
+  iov.iov_base = (void *) buffer;
+  iov.iov_len = size > 0 ? size : 0;
+  return inode_writev_at (inode, &iov, 1, offset);
+}
+
+/* Writes the CNT buffers described by IOV, in order, to
+   consecutive bytes of INODE starting at OFFSET.  If the buffers
+   are in kernel memory, INODE is locked once and the sectors for
+   the whole range are allocated in a single pass, before any
+   data is written.  User buffers are gathered into a staging
+   buffer and written one stage-full at a time, each allocated
+   and written under the lock in the same way.
+   Returns the total number of bytes actually written, which may
+   be less than requested if the disk fills up or an error
+   occurs. */
+off_t
+inode_writev_at (struct inode *inode, const struct iovec *iov, int cnt,
+                 off_t offset)
+{
+  uint8_t *bounce = NULL;
+  off_t size = iov_length (iov, cnt);
+  off_t bytes_written = 0;
+
+  if (size <= 0 || offset < 0)
+    return 0;
+
+  if (iov_in_user (iov, cnt))
+    bytes_written = writev_staged (inode, iov, cnt, size, offset, &bounce);
+  else
+    {
+      rwlock_acquire_write (&inode->rwlock);
+      bytes_written = writev_locked (inode, iov, cnt, size, offset, &bounce);
+      rwlock_release_write (&inode->rwlock);
+    }
+  if (bounce != NULL)
+    put_bounce (bounce);
+
+  return bytes_written;
+}
+
+/* Writes SIZE bytes from the CNT kernel buffers described by IOV
+   to INODE, starting at OFFSET, allocating sectors for the whole
+   range first.  Partial sectors go through *BOUNCE, as for
+   read_locked().
+   The caller must hold INODE's rwlock for writing.
+   Returns the number of bytes actually written. */
+static off_t
+writev_locked (struct inode *inode, const struct iovec *iov, int cnt,
+               off_t size, off_t offset, uint8_t **bounce)
+{
+  off_t bytes_written = 0;
+  int i;
+
+  if (inode->deny_write_cnt)
+    return 0;
+
+  size = inode_prepare_write (inode, offset, size);
+  for (i = 0; i < cnt && bytes_written < size; i++)
+    {
+      off_t len = iov[i].iov_len;
+      off_t n;
+
+      if (len > size - bytes_written)
+        len = size - bytes_written;
+      n = write_locked (inode, iov[i].iov_base, len,
+                        offset + bytes_written, bounce);
+      bytes_written += n;
+      if (n < len)
+        break;
+    }
+  if (bytes_written > 0 && (inode->data.flags & INODE_INLINE))
+    block_write (fs_device, inode->sector, &inode->data);
+  return bytes_written;
+}
+
+/* Writes SIZE bytes from the CNT user buffers described by IOV to
+   INODE, starting at OFFSET, gathering them into a staging buffer
+   so that INODE's rwlock is released whenever user memory is
+   touched.  Partial sectors go through *BOUNCE, as for
+   read_locked().
+   Returns the number of bytes actually written. */
+static off_t
+writev_staged (struct inode *inode, const struct iovec *iov, int cnt,
+               off_t size, off_t offset, uint8_t **bounce)
+{
+  size_t stage_size;
+  uint8_t *stage = get_stage (size, &stage_size);
+  off_t bytes_written = 0;
+  size_t iov_ofs = 0;
+  int i = 0;
+
+  if (stage == NULL)
+    return 0;
+
+  while (bytes_written < size)
+    {
+      struct iovec chunk;
+      off_t n;
+
+      chunk.iov_base = stage;
+      chunk.iov_len = size - bytes_written;
+      if (chunk.iov_len > stage_size)
+        chunk.iov_len = stage_size;
+      copy_iov (iov, cnt, &i, &iov_ofs, stage, chunk.iov_len, false);
+
+      rwlock_acquire_write (&inode->rwlock);
+      n = writev_locked (inode, &chunk, 1, chunk.iov_len,
+                         offset + bytes_written, bounce);
+      rwlock_release_write (&inode->rwlock);
+
+      bytes_written += n;
+      if (n < (off_t) chunk.iov_len)
+        break;
+    }
+
+  put_stage (stage);
+  return bytes_written;
+}
+
+/* Reserves disk space for the LENGTH bytes of INODE starting at
+   OFFSET, extending INODE if they go past its end, so that later
+   writes to them cannot run out of space.  The holes in that
+   range are given sectors taken from the free map in long
+   contiguous runs, in file order, so that the data can later be
+   read and written in large transfers.
+   Sectors past the valid length are not zeroed, since they read
+   as zeros anyway until they are written.
+   Returns true if successful, false if writes to INODE are
+   denied or the disk fills up, in which case part of the range
+   may have been reserved. */
+bool
+inode_allocate (struct inode *inode, off_t offset, off_t length)
+{
+  struct inode_disk *data = &inode->data;
+  off_t end = offset + length;
+  size_t first = offset / BLOCK_SECTOR_SIZE;
+  size_t last = bytes_to_sectors (end);
+  size_t holes = 0;
+  size_t i;
+  bool success = false;
+
+  if (offset < 0 || length < 0 || end < offset || last > MAX_SECTORS)
+    return false;
+
+  rwlock_acquire_write (&inode->rwlock);
+  if (inode->deny_write_cnt)
+    goto done;
+  if (data->flags & INODE_INLINE)
+    {
+      if (end <= (off_t) INLINE_MAX)
+        {
+          if (end > data->length)
+            {
+              data->length = end;
+              block_write (fs_device, inode->sector, data);
+            }
+          success = true;
+          goto done;
+        }
+      if (!inode_uninline (inode))
+        goto done;
+    }
+
+  for (i = first; i < last; i++)
+    if (index_lookup (data, i, false, false, 0) == 0)
+      holes++;
+
+  i = first;
+  while (holes > 0)
+    {
+      /* Ask the free map for a run of HOLES sectors, halving the
+         request until it can supply one.  The run found may be as
+         short as half the longest free run, but few calls are
+         needed to find it. */
+      block_sector_t start;
+      size_t cnt = holes;
+
+      while (!free_map_allocate (cnt, &start))
+        {
+          if (cnt == 1)
+            goto write_back;
+          cnt = DIV_ROUND_UP (cnt, 2);
+        }
+
+      /* Hand it out to the holes in file order.  A hole that
+         comes before the valid length must read as zeros. */
+      for (; cnt > 0; i++)
+        if (index_lookup (data, i, false, false, 0) == 0)
+          {
+            bool zero = (off_t) (i * BLOCK_SECTOR_SIZE) < data->valid_length;
+            if (index_lookup (data, i, true, zero, start) == 0)
+              {
+                free_map_release (start, cnt);
+                goto write_back;
+              }
+            start++;
+            cnt--;
+            holes--;
+          }
+    }
+
+  if (end > data->length)
+    data->length = end;
+  success = true;
+
+ write_back:
+  block_write (fs_device, inode->sector, data);
+ done:
+  rwlock_release_write (&inode->rwlock);
+  return success;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   inode->deny_write_cnt++;
-  ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->rwlock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,14 +1478,111 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   ASSERT (inode->deny_write_cnt > 0);
-  ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->rwlock);
+}
+
+/* Returns true if INODE is a directory. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  /* Never changes after inode_create(), so no lock is needed. */
+  return (inode->data.flags & INODE_DIR) != 0;
+}
+
+/* Returns true if INODE has been removed. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  bool removed;
+
+  lock_acquire (&inode_table_lock);
+  removed = inode->removed;
+  lock_release (&inode_table_lock);
+  return removed;
+}
+
+/* Returns the number of openers of INODE. */
+int
+inode_open_cnt (const struct inode *inode)
+{
+  int open_cnt;
+
+  lock_acquire (&inode_table_lock);
+  open_cnt = inode->open_cnt;
+  lock_release (&inode_table_lock);
+  return open_cnt;
 }
 
 /* Returns the length, in bytes, of INODE's data. */
 off_t
-inode_length (const struct inode *inode)
+inode_length (struct inode *inode)
+{
+  off_t length;
+
+  rwlock_acquire_read (&inode->rwlock);
+  length = inode->data.length;
+  rwlock_release_read (&inode->rwlock);
+  return length;
+}
+
+/* Fills in *ST with INODE's inumber, length, type, number of
+   openers, and number of sectors allocated to it, counting its
+   data and index sectors and the inode sector itself.  ST must
+   not be in user memory: a page fault on it would kill the
+   process while it holds INODE's rwlock. */
+void
+inode_stat (struct inode *inode, struct stat *st)
+{
+  st->st_ino = inode->sector;
+  st->st_isdir = inode_is_dir (inode);
+  st->st_opencnt = inode_open_cnt (inode);
+
+  rwlock_acquire_read (&inode->rwlock);
+  st->st_size = inode->data.length;
+  st->st_sectors = inode->data.sector_cnt + 1;
+  rwlock_release_read (&inode->rwlock);
+}
+
+/* Acquires INODE's general-purpose lock, which higher layers use
+   to serialize their own operations on INODE.  directory.c, for
+   example, holds it across every lookup or update of a
+   directory, and it protects the data attached with
+   inode_set_aux(). */
+void
+inode_lock (struct inode *inode)
+{
+  lock_acquire (&inode->lock);
+}
+
+/* Releases INODE's general-purpose lock. */
+void
+inode_unlock (struct inode *inode)
+{
+  lock_release (&inode->lock);
+}
+
+/* Returns the data attached to INODE with inode_set_aux(), or a
+   null pointer if there is none.
+   The caller must hold INODE's lock (see inode_lock()). */
+void *
+inode_get_aux (const struct inode *inode)
+{
+  return inode->aux;
+}
+
+/* Attaches AUX to INODE, for use by a higher layer that wants to
+   keep derived data for as long as INODE stays in memory.
+   DESTROY, if non-null, is called with AUX when INODE is freed.
+   Any previously attached data is destroyed first.
+   The caller must hold INODE's lock (see inode_lock()). */
+void
+inode_set_aux (struct inode *inode, void *aux, void (*destroy) (void *aux))
 {
-  return inode->data.length;
+  if (inode->destroy_aux != NULL && inode->aux != aux)
+    inode->destroy_aux (inode->aux);
+  inode->aux = aux;
+  inode->destroy_aux = destroy;
 }
@@ -6,9 +6,11 @@
 #include "devices/block.h"
 
 struct bitmap;
+struct iovec;
+struct stat;
 
 void inode_init (void);
-bool inode_create (block_sector_t, off_t);
+bool inode_create (block_sector_t, off_t, bool is_dir);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
@@ -16,8 +18,21 @@ void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+off_t inode_readv_at (struct inode *, const struct iovec *, int cnt,
+                      off_t offset);
+off_t inode_writev_at (struct inode *, const struct iovec *, int cnt,
+                       off_t offset);
+bool inode_allocate (struct inode *, off_t offset, off_t length);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
-off_t inode_length (const struct inode *);
+off_t inode_length (struct inode *);
+void inode_stat (struct inode *, struct stat *);
+bool inode_is_dir (const struct inode *);
+bool inode_is_removed (const struct inode *);
+int inode_open_cnt (const struct inode *);
+void inode_lock (struct inode *);
+void inode_unlock (struct inode *);
+void *inode_get_aux (const struct inode *);
+void inode_set_aux (struct inode *, void *aux, void (*destroy) (void *aux));
 
 #endif /* filesys/inode.h */
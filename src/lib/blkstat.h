@@ -0,0 +1,35 @@
+#ifndef __LIB_BLKSTAT_H
+#define __LIB_BLKSTAT_H
+
+#include <stdbool.h>
+
+/* Number of buckets in a latency histogram.  Bucket I counts
+   requests that took 2**I to 2**(I+1) - 1 TSC cycles.  Bucket 0
+   also counts those that took 0 cycles, and the last bucket
+   counts everything longer. */
+#define BLKSTAT_BUCKETS 32
+
+/* Statistics for requests in one direction, reads or writes,
+   counted as each request completes. */
+struct blkstat_dir
+  {
+    unsigned long long reqs;    /* Requests completed. */
+    unsigned long long bytes;   /* Bytes transferred. */
+    unsigned long long wait;    /* Total TSC cycles spent queued. */
+    unsigned long long service; /* Total TSC cycles spent in driver. */
+    unsigned wait_hist[BLKSTAT_BUCKETS];    /* Histogram of WAIT. */
+    unsigned service_hist[BLKSTAT_BUCKETS]; /* Histogram of SERVICE. */
+  };
+
+/* Statistics for a block device, as returned by blkstat(). */
+struct blkstat
+  {
+    char name[16];              /* Device name, e.g. "hda1". */
+    char type[16];              /* Type, e.g. "filesys" or "raw". */
+    bool role;                  /* Does it fill the role TYPE names? */
+    unsigned size;              /* Size in sectors. */
+    struct blkstat_dir read;    /* Reads. */
+    struct blkstat_dir write;   /* Writes. */
+  };
+
+#endif /* lib/blkstat.h */
@@ -0,0 +1,21 @@
+#ifndef __LIB_DIRENT_H
+#define __LIB_DIRENT_H
+
+/* Maximum length of a name in a struct dirent.  The same as
+   READDIR_MAX_LEN and the file system's NAME_MAX. */
+#define DIRENT_NAME_MAX 14
+
+/* Values for d_type. */
+#define DT_REG 1                /* Ordinary file. */
+#define DT_DIR 2                /* Directory. */
+
+/* One directory entry, as returned by getdents(). */
+struct dirent
+  {
+    unsigned d_ino;             /* Inode number. */
+    unsigned d_next;            /* Cookie to resume after this entry. */
+    unsigned char d_type;       /* DT_REG or DT_DIR. */
+    char d_name[DIRENT_NAME_MAX + 1]; /* Null terminated name. */
+  };
+
+#endif /* lib/dirent.h */
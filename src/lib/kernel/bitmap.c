@@ -359,6 +359,22 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the CNT bytes of B starting at byte offset OFS to the
+   same offset in FILE.  The range is clipped to the end of B.
+   Return true if successful, false otherwise. */
+bool
+bitmap_write_bytes (const struct bitmap *b, struct file *file,
+                    size_t ofs, size_t cnt)
+{
+  size_t size = byte_cnt (b->bit_cnt);
+  if (ofs >= size)
+    return true;
+  if (cnt > size - ofs)
+    cnt = size - ofs;
+  return file_write_at (file, (uint8_t *) b->bits + ofs, cnt, ofs)
+         == (off_t) cnt;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
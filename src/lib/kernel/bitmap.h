@@ -43,6 +43,8 @@ struct file;
 size_t bitmap_file_size (const struct bitmap *);
 bool bitmap_read (struct bitmap *, struct file *);
 bool bitmap_write (const struct bitmap *, struct file *);
+bool bitmap_write_bytes (const struct bitmap *, struct file *,
+                         size_t ofs, size_t cnt);
 #endif
 
 /* Debugging. */
@@ -0,0 +1,17 @@
+#ifndef __LIB_STAT_H
+#define __LIB_STAT_H
+
+#include <stdbool.h>
+
+/* Information about a file or directory, as returned by stat()
+   and fstat(). */
+struct stat
+  {
+    unsigned st_ino;            /* Inode number. */
+    int st_size;                /* Length in bytes. */
+    bool st_isdir;              /* Directory, not a file? */
+    int st_opencnt;             /* Number of times it is open. */
+    unsigned st_sectors;        /* Disk sectors allocated to it. */
+  };
+
+#endif /* lib/stat.h */
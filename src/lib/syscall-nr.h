@@ -28,7 +28,19 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_PREAD,                  /* Read from a file at a given offset. */
+    SYS_PWRITE,                 /* Write to a file at a given offset. */
+    SYS_READV,                  /* Read from a file into several buffers. */
+    SYS_WRITEV,                 /* Write several buffers to a file. */
+    SYS_COPY_FILE_RANGE,        /* Copy data from one file to another. */
+    SYS_FALLOCATE,              /* Reserve disk space for a file. */
+    SYS_GETDENTS,               /* Read many directory entries. */
+    SYS_STAT,                   /* Get information about a path. */
+    SYS_FSTAT,                  /* Get information about an open file. */
+    SYS_BLKSTAT                 /* Get I/O statistics for a block device. */
   };
 
 #endif /* lib/syscall-nr.h */
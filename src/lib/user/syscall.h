@@ -2,7 +2,11 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <blkstat.h>
 #include <debug.h>
+#include <dirent.h>
+#include <iovec.h>
+#include <stat.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +49,16 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+int pread (int fd, void *buffer, unsigned length, unsigned offset);
+int pwrite (int fd, const void *buffer, unsigned length, unsigned offset);
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+int copy_file_range (int in_fd, int out_fd, unsigned length);
+bool fallocate (int fd, unsigned offset, unsigned length);
+int getdents (int fd, unsigned cookie, struct dirent *ents, int cnt);
+bool stat (const char *path, struct stat *st);
+bool fstat (int fd, struct stat *st);
+bool blkstat (int dev, struct blkstat *st);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,78 @@
+/* Checks that blkstat() counts the reads and writes of a file's
+   data on the file system device. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[4096];
+
+/* Stores the statistics for the file system device in *ST.
+   Returns the number of block devices. */
+static int
+get_filesys_stats (struct blkstat *st)
+{
+  struct blkstat tmp;
+  bool found = false;
+  int dev;
+
+  for (dev = 0; blkstat (dev, &tmp); dev++)
+    if (tmp.role && !strcmp (tmp.type, "filesys"))
+      {
+        *st = tmp;
+        found = true;
+      }
+  if (!found)
+    fail ("no file system device");
+  return dev;
+}
+
+/* Fails unless D's histograms each count all of D's requests. */
+static void
+check_histograms (const char *kind, const struct blkstat_dir *d)
+{
+  unsigned long long wait_sum = 0, service_sum = 0;
+  int i;
+
+  for (i = 0; i < BLKSTAT_BUCKETS; i++)
+    {
+      wait_sum += d->wait_hist[i];
+      service_sum += d->service_hist[i];
+    }
+  if (wait_sum != d->reqs || service_sum != d->reqs)
+    fail ("%s histograms count %llu and %llu requests, not %llu",
+          kind, wait_sum, service_sum, d->reqs);
+}
+
+void
+test_main (void)
+{
+  struct blkstat before, after;
+  int dev_cnt;
+  int fd;
+
+  dev_cnt = get_filesys_stats (&before);
+  msg ("blkstat \"filesys\"");
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"a\"");
+  seek (fd, 0);
+  CHECK (read (fd, buf, sizeof buf) == sizeof buf, "read \"a\"");
+  close (fd);
+
+  get_filesys_stats (&after);
+  msg ("blkstat \"filesys\" again");
+  if (after.write.bytes < before.write.bytes + sizeof buf)
+    fail ("write bytes went from %llu to %llu",
+          before.write.bytes, after.write.bytes);
+  if (after.read.bytes < before.read.bytes + sizeof buf)
+    fail ("read bytes went from %llu to %llu",
+          before.read.bytes, after.read.bytes);
+  check_histograms ("read", &after.read);
+  check_histograms ("write", &after.write);
+
+  CHECK (!blkstat (dev_cnt, &after),
+         "blkstat past last device (must return false)");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(blkstat) begin
+(blkstat) blkstat "filesys"
+(blkstat) create "a"
+(blkstat) open "a"
+(blkstat) write "a"
+(blkstat) read "a"
+(blkstat) blkstat "filesys" again
+(blkstat) blkstat past last device (must return false)
+(blkstat) end
+EOF
+pass;
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($a) = {'sub' => {}};
+$a->{"f$_"} = [''] foreach 0...19;
+check_archive ({'a' => $a});
+pass;
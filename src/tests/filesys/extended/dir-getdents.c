@@ -0,0 +1,85 @@
+/* Lists a directory with getdents(), a few entries per call, and
+   checks that every entry comes back exactly once with the right
+   inumber and type. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 20
+
+static bool seen[FILE_CNT + 1];
+
+/* Checks entry E of directory "a". */
+static void
+check_entry (const struct dirent *e)
+{
+  char path[32];
+  int idx, fd;
+
+  if (!strcmp (e->d_name, "sub"))
+    {
+      if (e->d_type != DT_DIR)
+        fail ("\"a/sub\" listed with type %d", e->d_type);
+      idx = FILE_CNT;
+    }
+  else
+    {
+      idx = e->d_name[0] == 'f' ? atoi (e->d_name + 1) : -1;
+      if (idx < 0 || idx >= FILE_CNT)
+        fail ("unexpected entry \"%s\"", e->d_name);
+      if (e->d_type != DT_REG)
+        fail ("\"a/%s\" listed with type %d", e->d_name, e->d_type);
+    }
+  if (seen[idx])
+    fail ("\"a/%s\" listed twice", e->d_name);
+  seen[idx] = true;
+
+  snprintf (path, sizeof path, "a/%s", e->d_name);
+  CHECK ((fd = open (path)) > 1, "open \"%s\"", path);
+  if (inumber (fd) != (int) e->d_ino)
+    fail ("\"%s\" has inumber %d but was listed with %u",
+          path, inumber (fd), e->d_ino);
+  close (fd);
+}
+
+void
+test_main (void)
+{
+  struct dirent ents[3];
+  unsigned cookie = 0;
+  char path[32];
+  int dir_fd, fd, cnt, i;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (mkdir ("a/sub"), "mkdir \"a/sub\"");
+  msg ("creating a/f0 through a/f%d...", FILE_CNT - 1);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (path, sizeof path, "a/f%d", i);
+      CHECK (create (path, 0), "create \"%s\"", path);
+    }
+  quiet = false;
+
+  CHECK ((dir_fd = open ("a")) > 1, "open \"a\"");
+  msg ("getdents \"a\"");
+  quiet = true;
+  while ((cnt = getdents (dir_fd, cookie, ents, 3)) > 0)
+    {
+      for (i = 0; i < cnt; i++)
+        check_entry (&ents[i]);
+      cookie = ents[cnt - 1].d_next;
+    }
+  quiet = false;
+  for (i = 0; i <= FILE_CNT; i++)
+    if (!seen[i])
+      fail ("entry %d of \"a\" not listed", i);
+  msg ("every entry listed once");
+
+  CHECK ((fd = open ("a/f0")) > 1, "open \"a/f0\"");
+  CHECK (getdents (fd, 0, ents, 3) == -1, "getdents \"a/f0\" must fail");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-getdents) begin
+(dir-getdents) mkdir "a"
+(dir-getdents) mkdir "a/sub"
+(dir-getdents) creating a/f0 through a/f19...
+(dir-getdents) open "a"
+(dir-getdents) getdents "a"
+(dir-getdents) every entry listed once
+(dir-getdents) open "a/f0"
+(dir-getdents) getdents "a/f0" must fail
+(dir-getdents) end
+EOF
+pass;
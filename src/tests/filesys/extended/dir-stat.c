@@ -0,0 +1,36 @@
+/* Checks the information that stat() and fstat() return for a
+   file and a directory. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  struct stat st;
+  int fd;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (create ("a/b", 5000), "create \"a/b\"");
+  CHECK ((fd = open ("a/b")) > 1, "open \"a/b\"");
+
+  CHECK (stat ("a/b", &st), "stat \"a/b\"");
+  if (st.st_size != 5000 || st.st_isdir)
+    fail ("stat \"a/b\" gave size %d, isdir %d", st.st_size, st.st_isdir);
+  if ((int) st.st_ino != inumber (fd))
+    fail ("stat \"a/b\" gave inumber %u, not %d", st.st_ino, inumber (fd));
+  if (st.st_opencnt != 1)
+    fail ("stat \"a/b\" gave open count %d, not 1", st.st_opencnt);
+
+  CHECK (write (fd, "hello", 5) == 5, "write \"a/b\"");
+  CHECK (fstat (fd, &st), "fstat \"a/b\"");
+  if (st.st_size != 5000 || st.st_sectors < 2)
+    fail ("fstat \"a/b\" gave size %d, %u sectors",
+          st.st_size, st.st_sectors);
+
+  CHECK (stat ("a", &st), "stat \"a\"");
+  if (!st.st_isdir)
+    fail ("stat \"a\" did not report a directory");
+  CHECK (!stat ("a/c", &st), "stat \"a/c\" (must return false)");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-stat) begin
+(dir-stat) mkdir "a"
+(dir-stat) create "a/b"
+(dir-stat) open "a/b"
+(dir-stat) stat "a/b"
+(dir-stat) write "a/b"
+(dir-stat) fstat "a/b"
+(dir-stat) stat "a"
+(dir-stat) stat "a/c" (must return false)
+(dir-stat) end
+EOF
+pass;
@@ -0,0 +1,36 @@
+/* Copies "sample.txt" to a new file with copy_file_range(), in
+   two pieces, and verifies the copy.  Copying a file onto itself
+   must fail. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  size_t size = sizeof sample - 1;
+  int in_fd, out_fd, byte_cnt;
+
+  CHECK ((in_fd = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (create ("copy.txt", 0), "create \"copy.txt\"");
+  CHECK ((out_fd = open ("copy.txt")) > 1, "open \"copy.txt\"");
+
+  byte_cnt = copy_file_range (in_fd, out_fd, 100);
+  if (byte_cnt != 100)
+    fail ("copy_file_range() returned %d instead of 100", byte_cnt);
+  byte_cnt = copy_file_range (in_fd, out_fd, 4096);
+  if (byte_cnt != (int) size - 100)
+    fail ("copy_file_range() returned %d instead of %zu",
+          byte_cnt, size - 100);
+  msg ("copy \"sample.txt\" to \"copy.txt\"");
+
+  if (tell (in_fd) != size || tell (out_fd) != size)
+    fail ("file positions not advanced by copy_file_range()");
+  CHECK (copy_file_range (out_fd, out_fd, 10) == -1,
+         "copy \"copy.txt\" onto itself must fail");
+  close (out_fd);
+
+  check_file ("copy.txt", sample, size);
+}
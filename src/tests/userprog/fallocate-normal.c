@@ -0,0 +1,41 @@
+/* Reserves space for a file with fallocate(), checks that the
+   reserved bytes read as zeros, then writes into the middle of
+   the reservation and reads the whole file back. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 8192
+#define DATA_OFS 1000
+
+void
+test_main (void)
+{
+  static char buf[FILE_SIZE];
+  static char expected[FILE_SIZE];
+  size_t size = sizeof sample - 1;
+  int handle;
+
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+  CHECK (fallocate (handle, 0, FILE_SIZE), "fallocate \"test.txt\"");
+  if (filesize (handle) != FILE_SIZE)
+    fail ("filesize() returned %d instead of %d",
+          filesize (handle), FILE_SIZE);
+
+  if (read (handle, buf, FILE_SIZE) != FILE_SIZE)
+    fail ("read() of reserved bytes failed");
+  compare_bytes (buf, expected, FILE_SIZE, 0, "test.txt");
+  msg ("reserved bytes read as zeros");
+
+  if (pwrite (handle, sample, size, DATA_OFS) != (int) size)
+    fail ("pwrite() failed");
+  memcpy (expected + DATA_OFS, sample, size);
+  if (pread (handle, buf, FILE_SIZE, 0) != FILE_SIZE)
+    fail ("pread() failed");
+  compare_bytes (buf, expected, FILE_SIZE, 0, "test.txt");
+  msg ("verified contents of \"test.txt\"");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fallocate-normal) begin
+(fallocate-normal) create "test.txt"
+(fallocate-normal) open "test.txt"
+(fallocate-normal) fallocate "test.txt"
+(fallocate-normal) reserved bytes read as zeros
+(fallocate-normal) verified contents of "test.txt"
+(fallocate-normal) end
+fallocate-normal: exit(0)
+EOF
+pass;
@@ -0,0 +1,24 @@
+/* Tries to pread() from and pwrite() to invalid fds,
+   which must either fail silently or terminate the process with
+   exit code -1. */
+
+#include <limits.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char buf = 123;
+  pread (0x20101234, &buf, 1, 0);
+  pread (STDIN_FILENO, &buf, 1, 0);
+  pread (5, &buf, 1, 0);
+  pread (-1, &buf, 1, 0);
+  pread (INT_MIN, &buf, 1, 0);
+  pwrite (STDOUT_FILENO, &buf, 1, 0);
+  pwrite (5, &buf, 1, 0);
+  pwrite (-1, &buf, 1, 0);
+  pwrite (INT_MAX, &buf, 1, 0);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF', <<'EOF']);
+(pread-bad-fd) begin
+(pread-bad-fd) end
+pread-bad-fd: exit(0)
+EOF
+(pread-bad-fd) begin
+pread-bad-fd: exit(-1)
+EOF
+pass;
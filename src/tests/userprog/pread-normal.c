@@ -0,0 +1,33 @@
+/* Reads "sample.txt" with pread() at a series of offsets and
+   verifies that pread() does not move the file position. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buf[sizeof sample];
+  size_t ofs;
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  msg ("pread \"sample.txt\" at several offsets");
+  for (ofs = 0; ofs < sizeof sample - 1; ofs += 37)
+    {
+      size_t size = sizeof sample - 1 - ofs;
+      int byte_cnt = pread (handle, buf, size, ofs);
+      if (byte_cnt != (int) size)
+        fail ("pread() at offset %zu returned %d instead of %zu",
+              ofs, byte_cnt, size);
+      compare_bytes (buf, sample + ofs, size, ofs, "sample.txt");
+    }
+
+  if (tell (handle) != 0)
+    fail ("tell() returned %u after pread(), not 0", tell (handle));
+  if (pread (handle, buf, 1, sizeof sample - 1) != 0)
+    fail ("pread() at end of file did not return 0");
+}
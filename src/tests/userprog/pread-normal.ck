@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pread-normal) begin
+(pread-normal) open "sample.txt"
+(pread-normal) pread "sample.txt" at several offsets
+(pread-normal) end
+pread-normal: exit(0)
+EOF
+pass;
@@ -0,0 +1,36 @@
+/* Writes a file backward in chunks with pwrite(), verifies that
+   pwrite() does not move the file position, and reads the file
+   back. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  size_t ofs = sizeof sample - 1;
+  int handle;
+
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  msg ("pwrite \"test.txt\" back to front");
+  while (ofs > 0)
+    {
+      size_t size = ofs < 41 ? ofs : 41;
+      int byte_cnt;
+
+      ofs -= size;
+      byte_cnt = pwrite (handle, sample + ofs, size, ofs);
+      if (byte_cnt != (int) size)
+        fail ("pwrite() at offset %zu returned %d instead of %zu",
+              ofs, byte_cnt, size);
+    }
+
+  if (tell (handle) != 0)
+    fail ("tell() returned %u after pwrite(), not 0", tell (handle));
+
+  check_file_handle (handle, "test.txt", sample, sizeof sample - 1);
+}
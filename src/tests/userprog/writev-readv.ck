@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(writev-readv) begin
+(writev-readv) create "test.txt"
+(writev-readv) open "test.txt"
+(writev-readv) writev "test.txt"
+(writev-readv) readv "test.txt"
+(writev-readv) end
+writev-readv: exit(0)
+EOF
+pass;
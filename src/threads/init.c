@@ -34,6 +34,9 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
+#include "devices/stripe.h"
+#include "devices/virtio.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -56,6 +59,14 @@ static const char *scratch_bdev_name;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
+
+/* -stripe: Comma-separated names of block devices to stripe
+   together as the "stripe" block device. */
+static char *stripe_bdev_names;
+
+/* -ramdisk: Size in kB of the RAM disk ram0, or name of a block
+   device to copy into it. */
+static const char *ramdisk_spec;
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
@@ -127,6 +138,11 @@ main (void)
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  virtio_init ();
+  if (stripe_bdev_names != NULL)
+    stripe_init (stripe_bdev_names);
+  if (ramdisk_spec != NULL)
+    ramdisk_init (ramdisk_spec);
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
@@ -257,11 +273,21 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-stripe"))
+        stripe_bdev_names = value;
+      else if (!strcmp (name, "-ramdisk"))
+        ramdisk_spec = value;
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
 #endif
 #endif
+      else if (!strcmp (name, "-baud"))
+        {
+          if (value == NULL || !serial_set_bps (atoi (value)))
+            PANIC ("unsupported serial port speed `%s'",
+                   value != NULL ? value : "");
+        }
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
@@ -383,10 +409,14 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -stripe=BDEV,...   Stripe BDEVs together as block device stripe.\n"
+          "  -ramdisk=KB        Create empty KB-kB RAM disk ram0.\n"
+          "  -ramdisk=BDEV      Create RAM disk ram0 as a copy of BDEV.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
 #endif
+          "  -baud=BPS          Run serial port at BPS bits/s (default 9600).\n"
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
@@ -41,6 +41,25 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock.
+   Any number of readers may hold it at once, or a single
+   writer. */
+struct rwlock
+  {
+    struct lock lock;           /* Guards the fields below. */
+    struct condition no_writer; /* Signaled when the writer leaves. */
+    struct condition idle;      /* Signaled when the lock is free. */
+    int readers;                /* Number of readers holding it. */
+    struct thread *writer;      /* Thread holding it for writing. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -313,6 +313,14 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+#ifdef FILESYS
+  free (thread_current ()->bounce);
+  if (thread_current ()->stage_pages == 0)
+    free (thread_current ()->stage);
+  else
+    palloc_free_multiple (thread_current ()->stage,
+                          thread_current ()->stage_pages);
+#endif
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
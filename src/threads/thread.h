@@ -112,6 +112,16 @@ struct thread
     int mid;
 #endif
 
+#ifdef FILESYS
+    /* Owned by filesys/filesys.c. */
+    struct dir *cwd;                    /* Working directory, null for root. */
+
+    /* Owned by filesys/inode.c. */
+    void *bounce;                       /* Sector buffer, null until used. */
+    void *stage;                        /* User I/O buffer in use, or null. */
+    size_t stage_pages;                 /* Pages in stage, 0 if malloc'd. */
+#endif
+
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
   };
@@ -48,6 +48,9 @@ struct process* process_init (void)
   spage_init (&cur->spt);
   list_init (&cur->mmap_file_list);
   cur->mid = 3;
+  // inherit the parent's working directory.
+  if (cur->parent->cwd != NULL)
+    cur->cwd = dir_reopen (cur->parent->cwd);
   return process;
 }
 
@@ -68,6 +71,7 @@ void process_file_list_close (struct process* p)
     next = list_next (e);
     struct process_file* pf = list_entry (e, struct process_file, file_elem);
     file_close (pf->file);
+    dir_close (pf->dir);
     process_file_remove (pf);
     e = next;
   }
@@ -94,6 +98,7 @@ int process_file_init (struct file* file)
   struct process* p = thread_current ()->my_process;
   struct process_file* pf = (struct process_file*) malloc (sizeof(struct process_file));
   pf->file = file;
+  pf->dir = NULL;
   pf->fd = p->fd;
   p->fd ++;
   list_push_back (&p->files, &pf->file_elem);
@@ -262,6 +267,9 @@ process_exit (void)
   if (cur->my_process->exec_file != NULL)
     file_close (cur->my_process->exec_file);
 
+  dir_close (cur->cwd);
+  cur->cwd = NULL;
+
   if (!list_empty (&cur->mmap_file_list)) {
     for (int i=3; i<cur->mid; i++) {
       if (find_mmap_file (i) != NULL) munmap (i);
@@ -27,12 +27,11 @@ struct process
 struct process_file
   {
     struct file* file;
+    struct dir* dir;            /* non-NULL if the fd is a directory. */
     int fd;
     struct list_elem file_elem;
   };
 
-struct lock filesys_lock;
-
 struct process* process_init (void);
 void process_remove (struct process* process);
 int process_file_init (struct file* file);
@@ -1,29 +1,38 @@
 #include "userprog/syscall.h"
+#include <blkstat.h>
+#include <dirent.h>
+#include <iovec.h>
+#include <limits.h>
+#include <stat.h>
 #include <stdio.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/init.h"
+#include "devices/block.h"
 #include "devices/shutdown.h"
 #include "threads/vaddr.h"
 #include "devices/input.h"
+#include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
 #include "threads/malloc.h"
 #include <string.h>
 #include "vm/page.h"
 
-#define ARG_MAX 3 // define ARG_MAX.
+#define ARG_MAX 4 // define ARG_MAX.
 #define EXIT_SUCCESS 0 // define exit s/f.
 #define EXIT_FAILURE -1
 #define USER_VADDR_BOTTOM 0x08048000
+#define DIRENTS_MAX (PGSIZE / sizeof (struct dirent)) // getdents batch.
 typedef int pid_t; // define pid_t(Process indentifier).
 
 /* Personally defined functions. */
 void get_arguments (struct intr_frame* _f, 
-                    int* _args, int num_args);
+                    int** _args, int num_args);
 void check_ptr_valid (void* esp);
 struct process_file* find_file_by_fd (int fd);
 struct mmap_file* find_mmap_file (mapid_t mapid);
@@ -44,11 +53,25 @@ void seek (int fd, unsigned position);
 bool remove (const char* file);
 mapid_t mmap (int fd, void* addr);
 void munmap (mapid_t mapid);
+bool chdir (const char* dir);
+bool mkdir (const char* dir);
+bool readdir (int fd, char* name);
+bool isdir (int fd);
+int inumber (int fd);
+int pread (int fd, void* buffer, unsigned size, unsigned offset);
+int pwrite (int fd, const void* buffer, unsigned size, unsigned offset);
+int readv (int fd, const struct iovec* iov, int iovcnt);
+int writev (int fd, const struct iovec* iov, int iovcnt);
+int copy_file_range (int in_fd, int out_fd, unsigned length);
+bool fallocate (int fd, unsigned offset, unsigned length);
+int getdents (int fd, unsigned cookie, struct dirent* ents, int cnt);
+bool stat (const char* path, struct stat* st);
+bool fstat (int fd, struct stat* st);
+bool blkstat (int dev, struct blkstat* st);
 
 void
 syscall_init (void) 
 {
-  lock_init (&filesys_lock);
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
@@ -157,6 +180,104 @@ syscall_handler (struct intr_frame *f UNUSED)
       munmap ((mapid_t)*(int*)args[0]);
       break;
     }
+    case SYS_CHDIR:
+    {
+      get_arguments (f, args, 1);
+      f->eax = chdir ((const char*)*(int*)args[0]);
+      break;
+    }
+    case SYS_MKDIR:
+    {
+      get_arguments (f, args, 1);
+      f->eax = mkdir ((const char*)*(int*)args[0]);
+      break;
+    }
+    case SYS_READDIR:
+    {
+      get_arguments (f, args, 2);
+      f->eax = readdir (*(int*)args[0], (char*)*(int*)args[1]);
+      break;
+    }
+    case SYS_ISDIR:
+    {
+      get_arguments (f, args, 1);
+      f->eax = isdir (*(int*)args[0]);
+      break;
+    }
+    case SYS_INUMBER:
+    {
+      get_arguments (f, args, 1);
+      f->eax = inumber (*(int*)args[0]);
+      break;
+    }
+    case SYS_PREAD:
+    {
+      get_arguments (f, args, 4);
+      f->eax = pread (*(int*)args[0], (void*)*(int*)args[1],
+                      (unsigned)*(int*)args[2], (unsigned)*(int*)args[3]);
+      break;
+    }
+    case SYS_PWRITE:
+    {
+      get_arguments (f, args, 4);
+      f->eax = pwrite (*(int*)args[0], (const void*)*(int*)args[1],
+                       (unsigned)*(int*)args[2], (unsigned)*(int*)args[3]);
+      break;
+    }
+    case SYS_READV:
+    {
+      get_arguments (f, args, 3);
+      f->eax = readv (*(int*)args[0], (const struct iovec*)*(int*)args[1],
+                      *(int*)args[2]);
+      break;
+    }
+    case SYS_WRITEV:
+    {
+      get_arguments (f, args, 3);
+      f->eax = writev (*(int*)args[0], (const struct iovec*)*(int*)args[1],
+                       *(int*)args[2]);
+      break;
+    }
+    case SYS_COPY_FILE_RANGE:
+    {
+      get_arguments (f, args, 3);
+      f->eax = copy_file_range (*(int*)args[0], *(int*)args[1],
+                                (unsigned)*(int*)args[2]);
+      break;
+    }
+    case SYS_FALLOCATE:
+    {
+      get_arguments (f, args, 3);
+      f->eax = fallocate (*(int*)args[0], (unsigned)*(int*)args[1],
+                          (unsigned)*(int*)args[2]);
+      break;
+    }
+    case SYS_GETDENTS:
+    {
+      get_arguments (f, args, 4);
+      f->eax = getdents (*(int*)args[0], (unsigned)*(int*)args[1],
+                         (struct dirent*)*(int*)args[2], *(int*)args[3]);
+      break;
+    }
+    case SYS_STAT:
+    {
+      get_arguments (f, args, 2);
+      f->eax = stat ((const char*)*(int*)args[0],
+                     (struct stat*)*(int*)args[1]);
+      break;
+    }
+    case SYS_FSTAT:
+    {
+      get_arguments (f, args, 2);
+      f->eax = fstat (*(int*)args[0], (struct stat*)*(int*)args[1]);
+      break;
+    }
+    case SYS_BLKSTAT:
+    {
+      get_arguments (f, args, 2);
+      f->eax = blkstat (*(int*)args[0], (struct blkstat*)*(int*)args[1]);
+      break;
+    }
     default:
     {
 //      printf ("Strange syscall!!!!");
@@ -182,15 +303,12 @@ exec (const char* cmd_line)
   strlcpy (cpy, cmd_line, strlen(cmd_line)+1);
   char* token, save_ptr;
   token = strtok_r (cpy, " ", &save_ptr);
-  lock_acquire (&filesys_lock);
   struct file* f = filesys_open (token);
   if (f == NULL) {
-    lock_release (&filesys_lock);
     free (cpy);
     return -1;
   }
   file_close (f);
-  lock_release (&filesys_lock);
 
   int pid = process_execute (cmd_line);
   return pid;
@@ -228,11 +346,13 @@ write (int fd, const void* buffer, unsigned size)
     putbuf (buffer, size);
     return size;
   } else {
-    lock_acquire (&filesys_lock);
     // Find file with specified fd in current thread.
     struct process_file* pf = find_file_by_fd (fd);
+    // directories cannot be written.
+    if (pf == NULL || pf->dir != NULL) {
+      return -1;
+    }
     int count = file_write (pf->file, buffer, size);
-    lock_release (&filesys_lock);
     return count;
   }
 }
@@ -258,15 +378,12 @@ read (int fd, void* buffer, unsigned size)
     }
     return size;
   } else {
-    lock_acquire (&filesys_lock);
     // Find file with specified fd in current thread.
     struct process_file* pf = find_file_by_fd (fd);
-    if (pf == NULL) {
-      lock_release (&filesys_lock);
+    if (pf == NULL || pf->dir != NULL) {
       return -1;
     }
     int toReturn = file_read (pf->file, buffer, size);
-    lock_release (&filesys_lock);
     return toReturn;
   }
 }
@@ -281,9 +398,7 @@ create (const char* file, unsigned initial_size)
 
   // check file pointer whether valid.
   check_ptr_valid (file);
-  lock_acquire (&filesys_lock);
   bool success = filesys_create (file, initial_size);
-  lock_release (&filesys_lock);
 
   return success;
 }
@@ -297,18 +412,20 @@ open (const char* file)
     exit (EXIT_FAILURE);
   check_ptr_valid (file);
 
-  lock_acquire (&filesys_lock);
   // return null if fails to open, NULL check.
   struct file* file_ = filesys_open (file);
   if (file_ == NULL || file_ == "") {
-    lock_release (&filesys_lock);
     return EXIT_FAILURE;
   }
 
   // TODO if file name is same as currently running process's name, deny write.
   if (strcmp(thread_current ()->name, file) == 0) file_deny_write (file_);
   int toReturn = process_file_init (file_);
-  lock_release (&filesys_lock);
+
+  // directories also get a struct dir for readdir.
+  struct inode* inode = file_get_inode (file_);
+  if (inode_is_dir (inode))
+    find_file_by_fd (toReturn)->dir = dir_open (inode_reopen (inode));
 
   // find file from current thread or process.
   return toReturn;
@@ -318,18 +435,15 @@ open (const char* file)
 int
 filesize (int fd)
 {
-  lock_acquire (&filesys_lock);
   // find file with fd in current thread or process.
   struct process_file* pf = find_file_by_fd (fd);
   if (pf == NULL) {
-    lock_release (&filesys_lock);
     printf ("Something went wrong in filesize.\n");
     return -1;
   }
 
   // Use file_length() function.
   int toReturn = file_length (pf->file);
-  lock_release (&filesys_lock);
   return toReturn;
 }
 
@@ -337,33 +451,27 @@ filesize (int fd)
 void
 close (int fd)
 {
-  lock_acquire (&filesys_lock);
-
   struct process_file* pf = find_file_by_fd (fd);
   if (pf == NULL) {
-    lock_release (&filesys_lock);
     return ;//printf ("Something went wrong in close.\n");
   }
 
   file_close (pf->file);
+  dir_close (pf->dir);
   process_file_remove (pf);
-  lock_release (&filesys_lock);
 }
 
 // tell next position.
 unsigned
 tell (int fd)
 {
-  lock_acquire (&filesys_lock);
   // find file with fd in current thread or process.
   struct process_file* pf = find_file_by_fd (fd);
   if (pf == NULL) {
-    lock_release (&filesys_lock);
     return -1; //printf ("Something went wrong in tell.\n");
   }
 
   unsigned toReturn = file_tell (pf->file);
-  lock_release (&filesys_lock);
   return toReturn;
 }
 
@@ -371,25 +479,21 @@ tell (int fd)
 void
 seek (int fd, unsigned position)
 {
-  lock_acquire (&filesys_lock);
   // find file with fd in current thread or process.
   struct process_file* pf = find_file_by_fd (fd);
   if (pf == NULL) {
-    lock_release (&filesys_lock);
     return; //printf ("Something went wrong in seek.\n");
   }
 
   file_seek (pf->file, position);
-  lock_release (&filesys_lock);
 }
 
 // Implement remove.
 bool
 remove (const char* file)
 {
-  lock_acquire (&filesys_lock);
+  check_ptr_valid ((void*) file);
   bool success = filesys_remove (file);
-  lock_release (&filesys_lock);
   return success;
 }
 
@@ -397,12 +501,10 @@ remove (const char* file)
 mapid_t
 mmap (int fd, void* addr)
 {
-  lock_acquire (&filesys_lock);
   struct process_file* pf = find_file_by_fd (fd);
 
   if (fd == 0 || fd == 1 || file_length (pf->file) == 0 || (int) addr == 0 ||
       (int) addr % 4096 != 0) {
-    lock_release (&filesys_lock);
     return -1;
   }
   ASSERT (pf != NULL);
@@ -412,7 +514,6 @@ mmap (int fd, void* addr)
   uint32_t zero_bytes = (read_bytes % 4096 == 0) ? 0 :
                         ((((int) read_bytes/4096) + 1)*4096) - read_bytes;
   if (!lazy_load_segment_mmfile (f, 0, addr, read_bytes, zero_bytes, true)) {
-    lock_release (&filesys_lock);
     return -1;
   }
 
@@ -422,7 +523,6 @@ mmap (int fd, void* addr)
   mf->upage = addr;
   mf->file = f;
   list_push_back (&cur->mmap_file_list, &mf->elem);
-  lock_release (&filesys_lock);
   return mf->mid;
 }
 
@@ -438,6 +538,300 @@ munmap (mapid_t mapid)
   free (mf);
 }
 
+// change the working directory.
+bool
+chdir (const char* dir)
+{
+  check_ptr_valid ((void*) dir);
+  bool success = filesys_chdir (dir);
+  return success;
+}
+
+// create a directory.
+bool
+mkdir (const char* dir)
+{
+  check_ptr_valid ((void*) dir);
+  bool success = filesys_mkdir (dir);
+  return success;
+}
+
+// read the next entry of a directory fd into name. the entry is
+// read into kname first, so the directory is not locked while we
+// store to name, which may fault.
+bool
+readdir (int fd, char* name)
+{
+  char kname[NAME_MAX + 1];
+  check_ptr_valid (name);
+  struct process_file* pf = find_file_by_fd (fd);
+  bool success = pf != NULL && pf->dir != NULL && dir_readdir (pf->dir, kname);
+  if (success)
+    strlcpy (name, kname, sizeof kname);
+  return success;
+}
+
+// true if fd is a directory.
+bool
+isdir (int fd)
+{
+  struct process_file* pf = find_file_by_fd (fd);
+  bool toReturn = pf != NULL && pf->dir != NULL;
+  return toReturn;
+}
+
+// inode number (sector) of fd.
+int
+inumber (int fd)
+{
+  struct process_file* pf = find_file_by_fd (fd);
+  if (pf == NULL) {
+    return -1;
+  }
+  int toReturn = inode_get_inumber (file_get_inode (pf->file));
+  return toReturn;
+}
+
+// exit unless all SIZE bytes at BUFFER are user addresses, so the
+// end of the buffer cannot reach past PHYS_BASE into the kernel.
+static void
+check_user_buffer (const void* buffer, unsigned size)
+{
+  if (buffer >= PHYS_BASE || buffer <= (void*) USER_VADDR_BOTTOM
+      || size > (unsigned) ((const char*)PHYS_BASE - (const char*)buffer))
+    exit (EXIT_FAILURE);
+}
+
+// true if SIZE bytes at OFFSET lie within the range of an off_t.
+static bool
+file_range_ok (unsigned offset, unsigned size)
+{
+  return offset <= INT_MAX && size <= INT_MAX - offset;
+}
+
+// read at offset without moving the file position.
+int
+pread (int fd, void* buffer, unsigned size, unsigned offset)
+{
+  check_user_buffer (buffer, size);
+  if (!file_range_ok (offset, size))
+    return -1;
+
+  struct process_file* pf = find_file_by_fd (fd);
+  if (pf == NULL || pf->dir != NULL)
+    return -1;
+  return file_read_at (pf->file, buffer, size, offset);
+}
+
+// write at offset without moving the file position.
+int
+pwrite (int fd, const void* buffer, unsigned size, unsigned offset)
+{
+  check_ptr_valid ((void*) buffer);
+  check_user_buffer (buffer, size);
+  if (!file_range_ok (offset, size))
+    return -1;
+
+  struct process_file* pf = find_file_by_fd (fd);
+  if (pf == NULL || pf->dir != NULL)
+    return -1;
+  return file_write_at (pf->file, buffer, size, offset);
+}
+
+// copy a user iovec array into KIOV. exit if it or any buffer it
+// describes is not in user memory. false if the lengths add up to
+// more than an off_t can hold.
+static bool
+copy_in_iovec (struct iovec* kiov, const struct iovec* iov, int iovcnt)
+{
+  size_t total = 0;
+  int i;
+
+  check_ptr_valid ((void*) iov);
+  check_ptr_valid ((void*) (iov + iovcnt) - 1);
+  memcpy (kiov, iov, iovcnt * sizeof *kiov);
+  for (i = 0; i < iovcnt; i++)
+  {
+    if (kiov[i].iov_len > 0)
+      check_user_buffer (kiov[i].iov_base, kiov[i].iov_len);
+    if (kiov[i].iov_len > INT_MAX - total)
+      return false;
+    total += kiov[i].iov_len;
+  }
+  return true;
+}
+
+// readv: fill several buffers with one call.
+int
+readv (int fd, const struct iovec* iov, int iovcnt)
+{
+  struct iovec kiov[IOV_MAX];
+  int i;
+
+  if (iovcnt <= 0 || iovcnt > IOV_MAX)
+    return iovcnt == 0 ? 0 : -1;
+  if (!copy_in_iovec (kiov, iov, iovcnt))
+    return -1;
+
+  if (fd == STDIN_FILENO)
+  {
+    int count = 0;
+    for (i = 0; i < iovcnt; i++)
+      count += read (fd, kiov[i].iov_base, kiov[i].iov_len);
+    return count;
+  }
+
+  // whole transfer in one pass through the file system.
+  struct process_file* pf = find_file_by_fd (fd);
+  if (pf == NULL || pf->dir != NULL)
+    return -1;
+  return file_readv (pf->file, kiov, iovcnt);
+}
+
+// writev: write several buffers with one call.
+int
+writev (int fd, const struct iovec* iov, int iovcnt)
+{
+  struct iovec kiov[IOV_MAX];
+  int i;
+
+  if (iovcnt <= 0 || iovcnt > IOV_MAX)
+    return iovcnt == 0 ? 0 : -1;
+  if (!copy_in_iovec (kiov, iov, iovcnt))
+    return -1;
+  for (i = 0; i < iovcnt; i++)
+    if (kiov[i].iov_len > 0)
+      check_ptr_valid (kiov[i].iov_base);
+
+  if (fd == STDOUT_FILENO)
+  {
+    int count = 0;
+    for (i = 0; i < iovcnt; i++)
+    {
+      putbuf (kiov[i].iov_base, kiov[i].iov_len);
+      count += kiov[i].iov_len;
+    }
+    return count;
+  }
+
+  // whole transfer in one pass through the file system.
+  struct process_file* pf = find_file_by_fd (fd);
+  if (pf == NULL || pf->dir != NULL)
+    return -1;
+  return file_writev (pf->file, kiov, iovcnt);
+}
+
+// copy LENGTH bytes from in_fd to out_fd inside the kernel,
+// at both files' current positions. like linux, fails if both
+// are the same file, where the ranges could overlap.
+int
+copy_file_range (int in_fd, int out_fd, unsigned length)
+{
+  struct process_file* in = find_file_by_fd (in_fd);
+  struct process_file* out = find_file_by_fd (out_fd);
+  if (in == NULL || out == NULL || in->dir != NULL || out->dir != NULL)
+    return -1;
+  if (file_get_inode (in->file) == file_get_inode (out->file))
+    return -1;
+  return file_copy (out->file, in->file, length);
+}
+
+// reserve disk space for LENGTH bytes of fd starting at OFFSET,
+// growing the file if needed. the new bytes read as zeros.
+bool
+fallocate (int fd, unsigned offset, unsigned length)
+{
+  struct process_file* pf = find_file_by_fd (fd);
+  if (pf == NULL || pf->dir != NULL)
+    return false;
+  return file_allocate (pf->file, offset, length);
+}
+
+// fill ents with up to cnt entries of directory fd, starting at
+// entry number cookie. each entry's d_next is the cookie to pass
+// to continue after it. returns the number stored, 0 at the end.
+// like readdir, entries are read into a kernel copy first.
+int
+getdents (int fd, unsigned cookie, struct dirent* ents, int cnt)
+{
+  if (cnt <= 0)
+    return 0;
+  // so many entries could never fit below PHYS_BASE.
+  if ((unsigned) cnt > UINT_MAX / sizeof *ents)
+    exit (EXIT_FAILURE);
+  check_user_buffer (ents, cnt * sizeof *ents);
+
+  struct process_file* pf = find_file_by_fd (fd);
+  if (pf == NULL || pf->dir == NULL)
+    return -1;
+
+  if ((unsigned) cnt > DIRENTS_MAX)
+    cnt = DIRENTS_MAX;
+  struct dirent* kents = malloc (cnt * sizeof *kents);
+  if (kents == NULL)
+    return -1;
+  int stored = dir_read_entries (pf->dir, &cookie, kents, cnt);
+  memcpy (ents, kents, stored * sizeof *kents);
+  free (kents);
+  return stored;
+}
+
+// size, inumber, type, open count and sectors of path, without
+// opening an fd for it. filled in a kernel copy and copied out once
+// the inode is released, since st may fault.
+bool
+stat (const char* path, struct stat* st)
+{
+  struct stat kst;
+  check_ptr_valid ((void*) path);
+  check_user_buffer (st, sizeof *st);
+  if (!filesys_stat (path, &kst))
+    return false;
+  memcpy (st, &kst, sizeof kst);
+  return true;
+}
+
+// same as stat, for an open fd. a directory fd holds a second
+// reference for its dir, which is not another opener.
+bool
+fstat (int fd, struct stat* st)
+{
+  struct stat kst;
+  check_user_buffer (st, sizeof *st);
+  struct process_file* pf = find_file_by_fd (fd);
+  if (pf == NULL)
+    return false;
+  inode_stat (file_get_inode (pf->file), &kst);
+  if (pf->dir != NULL)
+    kst.st_opencnt--;
+  memcpy (st, &kst, sizeof kst);
+  return true;
+}
+
+// i/o statistics of block device number dev, counting from 0 in
+// the order the devices were registered. false past the last one.
+// gathered into a kernel copy first, since the block layer reads
+// them with interrupts off, where we must not fault on st.
+bool
+blkstat (int dev, struct blkstat* st)
+{
+  check_user_buffer (st, sizeof *st);
+
+  struct block* block = block_first ();
+  for (; block != NULL && dev > 0; dev--)
+    block = block_next (block);
+  if (block == NULL || dev < 0)
+    return false;
+
+  struct blkstat* kst = malloc (sizeof *kst);
+  if (kst == NULL)
+    return false;
+  block_get_stats (block, kst);
+  memcpy (st, kst, sizeof *kst);
+  free (kst);
+  return true;
+}
+
 /* find mmap_file from current thread. */
 struct mmap_file*
 find_mmap_file (mapid_t mapid)
@@ -478,10 +872,10 @@ mmap_file_list_destroy (struct list* mfl)
 /* Retrieve arguments from syscalls.
           Store address of args into _args. */
 void
-get_arguments (struct intr_frame* _f, int* _args, int num_args)
+get_arguments (struct intr_frame* _f, int** _args, int num_args)
 {
   int* ptr = _f->esp;
-  int* args = _args;
+  int** args = _args;
 
   for (int i=0; i<num_args; i++)
   {
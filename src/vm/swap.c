@@ -32,11 +32,9 @@ swap_in (void* kpage, size_t idx)
   lock_acquire (&swap_lock);
   bitmap_flip (swap_table, idx);
 
-  for (int i=0; i<PGSIZE/BLOCK_SECTOR_SIZE; i++)
-  {
-    block_read (swap_block, (idx*PGSIZE/BLOCK_SECTOR_SIZE)+i,
-                kpage+(i*BLOCK_SECTOR_SIZE));
-  }
+  // Read the whole page with a single multi-sector request.
+  block_read_multiple (swap_block, idx*PGSIZE/BLOCK_SECTOR_SIZE,
+                       PGSIZE/BLOCK_SECTOR_SIZE, kpage);
   lock_release (&swap_lock);
   return true;
 }
@@ -51,11 +49,9 @@ swap_out (void* kpage)
   size_t idx = bitmap_scan_and_flip (swap_table, 0, 1, SWAP_FREE);
   ASSERT (idx != BITMAP_ERROR);
 
-  for (int i=0; i<PGSIZE/BLOCK_SECTOR_SIZE; i++)
-  {
-    block_write (swap_block, (idx*PGSIZE/BLOCK_SECTOR_SIZE)+i,
-                 kpage+(i*BLOCK_SECTOR_SIZE));
-  }
+  // Write the whole page with a single multi-sector request.
+  block_write_multiple (swap_block, idx*PGSIZE/BLOCK_SECTOR_SIZE,
+                        PGSIZE/BLOCK_SECTOR_SIZE, kpage);
 
   lock_release (&swap_lock);
   return idx;